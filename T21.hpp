@@ -20,6 +20,7 @@
 
 #include "logger.hpp"
 #include "node.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 #include <span>
@@ -97,18 +98,25 @@ struct T21 final : regular_node {
 	T21(int x, int y)
 	    : regular_node(x, y, type_t::T21) {}
 
-	[[gnu::always_inline]] inline void step(logger& debug) {
+	template <typename Log>
+	[[gnu::always_inline]] inline void step(Log& debug) {
 		assert(not code.empty());
 		debug << "step(" << x << ',' << y << ',' << pc << "): instruction type: ";
 		if (s == activity::write) {
 			// if waiting for a write, then this instruction's read already
 			// happened
+			if constexpr (event_sink<Log>) {
+				debug.record(trace(trace_event::step, word_empty));
+			}
 			debug << "MOV stalled[W]" << '\n';
 			return;
 		}
 		auto& instr = code[to_unsigned(pc)];
 		debug.log_r([&] { return to_string(instr.op_); });
 		auto r = read(instr.src, instr.val);
+		if constexpr (event_sink<Log>) {
+			debug.record(trace(trace_event::step, r));
+		}
 		if (r == word_empty) {
 			debug << " stalled[R]" << '\n';
 			s = activity::read;
@@ -236,7 +244,13 @@ struct T21 final : regular_node {
 		debug << '\n';
 	}
 
-	[[gnu::always_inline]] inline void finalize(logger& debug) {
+	template <typename Log>
+	[[gnu::always_inline]] inline void finalize(Log& debug) {
+		if constexpr (event_sink<Log>) {
+			auto e = trace(trace_event::finalize, write_word);
+			e.dst = write_port;
+			debug.record(e);
+		}
 		if (s == activity::write) {
 			debug << "finalize(" << x << ',' << y << ',' << pc << "): mov ";
 			// if write completed
@@ -303,6 +317,35 @@ struct T21 final : regular_node {
 		}
 	}
 
+	/// The activity of the node, as shown by the game's debugger
+	activity activity_state() const noexcept { return s; }
+
+	/// Everything that changes while running a test
+	struct saved_state {
+		word_t acc;
+		word_t bak;
+		word_t pc;
+		optional_word write_word;
+		port write_port;
+		port last;
+		activity s;
+
+		bool operator==(const saved_state&) const = default;
+	};
+	saved_state save() const noexcept {
+		return {acc, bak, pc, write_word, write_port, last, s};
+	}
+	bool matches(const saved_state& st) const noexcept { return save() == st; }
+	void restore(const saved_state& st) noexcept {
+		acc = st.acc;
+		bak = st.bak;
+		pc = st.pc;
+		write_word = st.write_word;
+		write_port = st.write_port;
+		last = st.last;
+		s = st.s;
+	}
+
 	bool has_instr(std::same_as<instr::op> auto... ops) const {
 		return std::any_of(code.begin(), code.end(), [=](const instr& i) {
 			return ((i.op_ == ops) or ...);
@@ -321,6 +364,23 @@ struct T21 final : regular_node {
 
 	/// Increment the program counter, wrapping to beginning.
 	inline void next() { pc = to_word((pc + 1) % code.size()); }
+	/// The state of the node, as recorded in binary traces
+	trace_event trace(trace_event::kind_t kind, word_t r) const noexcept {
+		auto& i = code[to_unsigned(pc)];
+		return {.x = static_cast<std::int16_t>(x),
+		        .y = static_cast<std::int16_t>(y),
+		        .kind = kind,
+		        .op = i.op_,
+		        .s = s,
+		        .dst = i.dst,
+		        .last = last,
+		        .pc = pc,
+		        .acc = acc,
+		        .bak = bak,
+		        .r = r,
+		        .val = i.val,
+		        .size = to_word(code.size())};
+	}
 	/// Attempt to read a value from this node's port p, which may be
 	/// any, last, or immediate, unlike the general do_read and emit
 	/// functions
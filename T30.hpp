@@ -22,25 +22,63 @@
 #include "node.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+/// Values that all the T30 nodes of the process, in every field and thread,
+/// may have storage for at once. Storage grows as values are stored, so a
+/// large T30 size only costs memory if it's used.
+struct T30_budget {
+	/// Default 100M values
+	std::size_t limit = 100'000'000;
+	std::atomic<std::size_t> used;
+
+	/// @throws std::runtime_error if n more values would exceed the limit
+	void take(std::size_t n, int x, int y) {
+		auto before = used.fetch_add(n, std::memory_order_relaxed);
+		if (before + n > limit) {
+			used.fetch_sub(n, std::memory_order_relaxed);
+			throw std::runtime_error{
+			    concat("T30 (", x, ',', y, ") can't grow to hold more values, ",
+			           "the T30 nodes already have storage for ", before,
+			           " values out of a budget of ", limit)};
+		}
+	}
+	void give_back(std::size_t n) noexcept {
+		used.fetch_sub(n, std::memory_order_relaxed);
+	}
+};
+inline T30_budget T30_memory;
+
 struct T30 final : regular_node {
+	/// Storage is allocated for this many values up front, and then doubled
+	/// as needed up to max_size
+	static constexpr std::size_t initial_capacity = 32;
+
 	T30(int x, int y, std::size_t max_size)
 	    : regular_node(x, y, type_t::T30)
 	    , max_size(max_size) {
-		data.reserve(max_size);
+		reserve(std::min(max_size, initial_capacity));
 	}
+	~T30() { T30_memory.give_back(reserved); }
 	void reset() noexcept {
 		write_word = word_empty;
 		write_port = port::any;
 		data.clear();
-		prev_end = data.end();
+		prev_end = 0;
 	}
 
-	inline void step(logger&) {
+	template <typename Log>
+	inline void step(Log&) {
 		if (data.size() == max_size) {
 			return;
 		}
 		for (auto p = port::dir_first; p <= port::dir_last; p++) {
 			if (auto r = do_read(p); r != word_empty) {
+				if (data.size() == reserved) [[unlikely]] {
+					reserve(std::min(reserved * 2, max_size));
+				}
 				data.push_back(r);
 				used = true;
 				if (data.size() == max_size) {
@@ -49,13 +87,14 @@ struct T30 final : regular_node {
 			}
 		}
 	}
-	inline void finalize(logger&) {
+	template <typename Log>
+	inline void finalize(Log&) {
 		if (write_port != port::any) {
-			data.erase(prev_end);
+			data.erase(data.begin() + prev_end);
 			write_port = port::any;
 		}
 		if (not data.empty()) {
-			prev_end = data.end() - 1;
+			prev_end = std::ssize(data) - 1;
 			write_word = data.back();
 		}
 	}
@@ -71,11 +110,49 @@ struct T30 final : regular_node {
 		return ret;
 	}
 
+	/// number of values currently stored
+	std::size_t depth() const noexcept { return data.size(); }
+
+	/// Everything that changes while running a test
+	struct saved_state {
+		word_vec data;
+		std::ptrdiff_t prev_end;
+		optional_word write_word;
+		port write_port;
+
+		bool operator==(const saved_state&) const = default;
+	};
+	saved_state save() const { return {data, prev_end, write_word, write_port}; }
+	/// Compared in place, without copying the values
+	bool matches(const saved_state& st) const noexcept {
+		return data == st.data and prev_end == st.prev_end
+		       and write_word == st.write_word and write_port == st.write_port;
+	}
+	void restore(const saved_state& st) {
+		if (st.data.size() > reserved) {
+			reserve(st.data.size());
+		}
+		data.assign(st.data.begin(), st.data.end());
+		prev_end = st.prev_end;
+		write_word = st.write_word;
+		write_port = st.write_port;
+	}
+
 	bool used{}; // persistent among all tests
 
  private:
+	/// Grow the storage to n values, counted in T30_memory
+	void reserve(std::size_t n) {
+		T30_memory.take(n - reserved, x, y);
+		data.reserve(n);
+		reserved = n;
+	}
+
 	word_vec data;
-	word_vec::iterator prev_end;
+	/// index of the value offered to the neighbors
+	std::ptrdiff_t prev_end{};
+	/// values counted in T30_memory
+	std::size_t reserved{};
 	std::size_t max_size{def_T30_size};
 };
 
@@ -0,0 +1,47 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+// Test: the fixed tests embedded by gen_static_suites must be the ones the
+// level generators give for base_seed * 100 + {0, 1, 2}
+
+#include "levels.hpp"
+
+#include <iostream>
+
+static bool operator==(const single_test& a, const single_test& b) {
+	return a.inputs == b.inputs and a.n_outputs == b.n_outputs
+	       and a.i_outputs == b.i_outputs;
+}
+
+int main() {
+	int mismatches{};
+	for (auto id : range(builtin_levels_num)) {
+		builtin_level l(static_cast<uint>(id));
+		const auto& suite = l.static_suite();
+		for (auto i : range(suite.size())) {
+			auto seed = l.base_seed * 100 + static_cast<std::uint32_t>(i);
+			if (not (suite[i] == *l.random_test(seed))) {
+				std::cerr << "Fixed test " << i << " of "
+				          << builtin_layouts[id].segment
+				          << " doesn't match random test " << seed << '\n';
+				++mismatches;
+			}
+		}
+	}
+	return mismatches == 0 ? 0 : 1;
+}
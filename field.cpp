@@ -20,8 +20,7 @@
 
 #include <algorithm>
 #include <bitset>
-#include <queue>
-#include <unordered_set>
+#include <limits>
 
 using dir_mask = std::bitset<DIMENSIONS * 2>;
 
@@ -109,66 +108,74 @@ constexpr dir_mask out_links(const regular_node* n) {
 static constexpr std::array<std::pair<int, int>, 2 * DIMENSIONS> delta_lookup{
     {{-1, 0}, {1, 0}, {0, -1}, {0, 1}}};
 
-// search for an output node connected (by imask U omask) to this one
-bool field::search_for_output(const regular_node* p) {
-	struct entry {
-		const regular_node* n;
-		// use height as heuristic, because outputs are always at bottom
-		bool operator<(const entry& rhs) const { return n->y < rhs.n->y; }
+// Mark the nodes connected (by imask U omask) to an output node or to another
+// node with HCF, labelling the connected components in a single pass. A T30
+// that nothing writes to is a dead end: it's never simulated and doesn't
+// connect its neighbors.
+std::vector<bool> field::connected_to_output() {
+	constexpr auto none = std::numeric_limits<std::size_t>::max();
+	auto index = [&](const node* n) {
+		return to_unsigned(n->y) * width + to_unsigned(n->x);
 	};
-	// std::priority_queue defaults to a max-heap
-	std::priority_queue<entry> queue;
-	std::unordered_set<const regular_node*> searched;
-	auto pop = [&] {
-		auto tmp = queue.top();
-		queue.pop();
-		return tmp;
+	auto expandable = [](const regular_node* n) {
+		return n->type != node::T30
+		       or std::ranges::any_of(n->neighbors, std::identity{});
+	};
+	auto has_hcf = [](const regular_node* n) {
+		return n->type == node::T21
+		       and static_cast<const T21*>(n)->has_instr(instr::hcf);
 	};
-	{
-		queue.push({p});
-		searched.insert(p);
-	}
 
-	while (not queue.empty()) {
-		auto n = pop().n;
-		log_debug("Searching node (", n->x, ", ", n->y, ")");
-		if (n->type == node::T30) {
-			if (std::ranges::none_of(n->neighbors, std::identity{})) {
-				continue;
-			}
+	struct component_info {
+		bool output{};
+		std::size_t hcf_nodes{};
+	};
+	std::vector<std::size_t> component(nodes_regular.size(), none);
+	std::vector<component_info> components;
+	std::vector<regular_node*> stack;
+	for (auto& start : nodes_regular) {
+		auto p = start.get();
+		if (not useful(p) or not expandable(p)
+		    or component[index(p)] != none) {
+			continue;
 		}
-		for (auto d = port::dir_first; d <= port::dir_last; ++d) {
-			auto neighbor_x = n->x + delta_lookup[d].first;
-			auto neighbor_y = n->y + delta_lookup[d].second;
-			auto neighbor = useful_node_at(neighbor_x, neighbor_y);
-			if (neighbor) {
-				if ((n->neighbors[d] or neighbor->neighbors[invert(d)])
-				    and searched.insert(neighbor).second) {
-					if (neighbor->type == node::T21
-					    and static_cast<const T21*>(neighbor)->has_instr(
-					        instr::hcf)) {
-						log_debug(" Neighbor has hcf");
-						return true;
-					}
-					queue.push({neighbor});
-				}
-			} else if (neighbor_y == static_cast<int>(height())) {
-				for (auto& o : nodes_numeric) {
-					if (o->linked == n) {
-						log_debug(" Neighbor is numeric output");
-						return true;
-					}
-				}
-				for (auto& o : nodes_image) {
-					if (o->linked == n) {
-						log_debug(" Neighbor is image output");
-						return true;
-					}
+		auto c = components.size();
+		auto& info = components.emplace_back();
+		component[index(p)] = c;
+		stack.push_back(p);
+		while (not stack.empty()) {
+			auto n = stack.back();
+			stack.pop_back();
+			log_debug("Searching node (", n->x, ", ", n->y, ")");
+			info.hcf_nodes += has_hcf(n);
+			for (auto d = port::dir_first; d <= port::dir_last; ++d) {
+				auto neighbor = useful_node_at(n->x + delta_lookup[d].first,
+				                               n->y + delta_lookup[d].second);
+				if (neighbor and expandable(neighbor)
+				    and (n->neighbors[d] or neighbor->neighbors[invert(d)])
+				    and component[index(neighbor)] == none) {
+					component[index(neighbor)] = c;
+					stack.push_back(neighbor);
 				}
 			}
 		}
 	}
-	return false;
+	for_each_output([&](output_node* o) {
+		if (o->linked and component[index(o->linked)] != none) {
+			components[component[index(o->linked)]].output = true;
+		}
+	});
+
+	// a node with HCF needs another one to be kept, as it doesn't need itself
+	std::vector<bool> ret(nodes_regular.size());
+	for (auto& n : nodes_regular) {
+		auto i = index(n.get());
+		if (component[i] != none) {
+			auto& info = components[component[i]];
+			ret[i] = info.output or info.hcf_nodes > has_hcf(n.get());
+		}
+	}
+	return ret;
 }
 
 void field::finalize_nodes() {
@@ -234,9 +241,10 @@ void field::finalize_nodes() {
 	});
 
 	// register for simulation
-	for (auto& p : nodes_regular) {
+	auto connected = connected_to_output();
+	for (auto [p, i] : kblib::enumerate(nodes_regular)) {
 		if (useful(p.get())) {
-			if (search_for_output(p.get())) {
+			if (connected[i]) {
 				log_debug("node at (", p->x, ", ", p->y, ") marked useful");
 				regulars_to_sim.push_back(p.get());
 				allT21 &= p->type == node::T21;
@@ -251,10 +259,12 @@ void field::finalize_nodes() {
 	if (allT21) {
 		log_debug("All used regular nodes are T21, faster simulation enabled");
 	}
+	unrolled_nodes = regulars_to_sim.size() <= max_unrolled_nodes
+	                     ? regulars_to_sim.size()
+	                     : 0;
 	for (auto& i : nodes_input) {
 		auto n = useful_node_at(i->x, 0);
-		if (n and n->neighbors[up]
-		    and std::ranges::contains(regulars_to_sim, n)) {
+		if (n and n->neighbors[up] and connected[to_unsigned(i->x)]) {
 			inputs_to_sim.push_back(i.get());
 		} else {
 			log_debug("Input node at (", i->x, ", ", i->y, ") dropped");
@@ -280,6 +290,62 @@ void field::finalize_nodes() {
 	}
 }
 
+field::parallel_plan field::plan_parallel(std::size_t threads,
+                                          std::size_t min_nodes) const {
+	const auto n = regulars_to_sim.size();
+	threads = std::clamp<std::size_t>(n / min_nodes, 1, threads);
+	parallel_plan plan;
+	plan.step.resize(threads);
+	plan.finalize.resize(threads);
+
+	// owner thread of each simulated node, by position in nodes_regular
+	std::vector<std::size_t> owner(nodes_regular.size(), threads);
+	auto index = [&](const node* p) {
+		return to_unsigned(p->y) * width + to_unsigned(p->x);
+	};
+	auto simulated = [&](const node* p) {
+		return (p->type == node::T21 or p->type == node::T30)
+		       and owner[index(p)] != threads;
+	};
+	for (auto [p, i] : kblib::enumerate(regulars_to_sim)) {
+		owner[index(p)] = i * threads / n;
+	}
+	auto offers_to_any = [](const node* p) {
+		return p->type == node::T30
+		       or std::ranges::any_of(static_cast<const T21*>(p)->code,
+		                              [](const instr& i) {
+			                              return i.op_ == instr::mov
+			                                     and i.dst == port::any;
+		                              });
+	};
+	// links go from reader to writer, a writer must also be serial if one of
+	// its readers belongs to another thread
+	std::vector<bool> serial(nodes_regular.size());
+	for (auto p : regulars_to_sim) {
+		for (auto w : p->neighbors) {
+			if (not w or not simulated(w)) {
+				continue;
+			}
+			if (owner[index(w)] != owner[index(p)]) {
+				serial[index(p)] = true;
+				serial[index(w)] = true;
+			} else if (offers_to_any(w)) {
+				serial[index(p)] = true;
+			}
+		}
+	}
+	for (auto p : regulars_to_sim) {
+		auto t = owner[index(p)];
+		if (serial[index(p)]) {
+			plan.serial.push_back(p);
+		} else {
+			plan.step[t].push_back(p);
+		}
+		plan.finalize[t].push_back(p);
+	}
+	return plan;
+}
+
 std::size_t field::instructions() const {
 	std::size_t ret{};
 	for (auto& i : nodes_regular) {
@@ -343,8 +409,8 @@ std::string field::layout() const {
 	}
 	for (auto& im : nodes_image) {
 		append(ret, 'V', im->x, " ", im->width, ',', im->height);
-		if (not im->image_expected.blank()) {
-			append(ret, " [", im->image_expected.write_text(false), "]");
+		if (im->image_expected and not im->image_expected->blank()) {
+			append(ret, " [", im->image_expected->write_text(false), "]");
 		}
 		append(ret, ' ');
 	}
@@ -352,14 +418,91 @@ std::string field::layout() const {
 	return ret;
 }
 
+#if TIS_ENABLE_PROFILE
+std::string field::profile_report(bool colored) const {
+	std::string ret = concat("Node utilization over ", profile_cycles,
+	                         " cycles (.: unused, D: damaged)\n");
+	if (profile_cycles == 0) {
+		return ret;
+	}
+	auto percent = [&](std::size_t c) { return c * 100 / profile_cycles; };
+	auto heat = [&](std::size_t pct) {
+		if (not colored or pct < 25) {
+			return std::string{};
+		} else if (pct < 50) {
+			return escape_code(bg_green);
+		} else if (pct < 75) {
+			return escape_code(bg_yellow);
+		} else {
+			return escape_code(bg_red);
+		}
+	};
+
+	for (auto a : {activity::run, activity::read, activity::write,
+	               activity::idle}) {
+		append(ret, state_name(a), ':');
+		for (auto [p, i] : kblib::enumerate(nodes_regular)) {
+			if (i % width == 0) {
+				ret += '\n';
+			}
+			if (std::ranges::contains(regulars_to_sim, p.get())) {
+				auto pct = percent(p->profile.cycles[to_unsigned(etoi(a))]);
+				append(ret, heat(pct), pad_left(pct, 4), '%',
+				       colored ? escape_code(none) : "", ' ');
+			} else if (p->type == node::Damaged) {
+				ret += "   D  ";
+			} else {
+				ret += "   .  ";
+			}
+		}
+		ret += '\n';
+	}
+
+	ret += "Port traffic (words in/out):\n";
+	const regular_node* busiest{};
+	for (auto p : regulars_to_sim) {
+		append(ret, '(', p->x, ',', p->y, ") ", to_string(p->type), ':');
+		for (auto d = port::dir_first; d <= port::dir_last; ++d) {
+			auto in = p->profile.words_in[d];
+			auto out = p->profile.words_out[d];
+			if (in or out) {
+				append(ret, ' ', port_name(d), ' ', in, '/', out);
+			}
+		}
+		if (p->type == node::T30) {
+			append(ret, " peak depth ", p->profile.peak_depth);
+		} else if (not busiest
+		           or p->profile.cycles[etoi(activity::run)]
+		                  > busiest->profile.cycles[etoi(activity::run)]) {
+			busiest = p;
+		}
+		ret += '\n';
+	}
+	if (busiest) {
+		append(ret, "Busiest node: (", busiest->x, ',', busiest->y, ") ",
+		       percent(busiest->profile.cycles[etoi(activity::run)]),
+		       "% RUN\n");
+	}
+	return ret;
+}
+#endif
+
 field field::clone() const {
 	field ret;
+	ret.width = width;
 
+	// every node is cloned at the same position of the same vector, so
+	// positions map a node to its copy, and the links and simulation lists
+	// are copied instead of computed again by finalize_nodes
 	for (auto& n : nodes_input) {
 		ret.nodes_input.push_back(n->clone());
 	}
 	for (auto& n : nodes_regular) {
 		ret.nodes_regular.push_back(n->clone());
+		if (n->type == node::T21) {
+			ret.nodes_t21.push_back(
+			    static_cast<T21*>(ret.nodes_regular.back().get()));
+		}
 	}
 	for (auto& n : nodes_numeric) {
 		ret.nodes_numeric.push_back(n->clone());
@@ -368,9 +511,132 @@ field field::clone() const {
 		ret.nodes_image.push_back(n->clone());
 	}
 
-	ret.width = width;
+	// IO nodes are at most one per column
+	auto by_column = [&](const auto& from, const auto& to) {
+		std::vector<std::remove_cvref_t<decltype(to[0].get())>> table(width);
+		for (auto [n, i] : kblib::enumerate(from)) {
+			table[to_unsigned(n->x)] = to[i].get();
+		}
+		return table;
+	};
+	auto inputs = by_column(nodes_input, ret.nodes_input);
+	auto numerics = by_column(nodes_numeric, ret.nodes_numeric);
+	auto images = by_column(nodes_image, ret.nodes_image);
+	auto regular = [&](const node* n) {
+		return ret.nodes_regular[to_unsigned(n->y) * width + to_unsigned(n->x)]
+		    .get();
+	};
+
+	for (auto [n, i] : kblib::enumerate(nodes_regular)) {
+		for (auto [neighbor, d] : kblib::enumerate(n->neighbors)) {
+			if (not neighbor) {
+				continue;
+			}
+			// only input nodes are linked outside of the regular nodes
+			ret.nodes_regular[i]->neighbors[d]
+			    = neighbor->type == node::in
+			          ? static_cast<node*>(inputs[to_unsigned(neighbor->x)])
+			          : regular(neighbor);
+		}
+	}
+	for (auto [n, i] : kblib::enumerate(nodes_numeric)) {
+		if (n->linked) {
+			ret.nodes_numeric[i]->linked = regular(n->linked);
+		}
+	}
+	for (auto [n, i] : kblib::enumerate(nodes_image)) {
+		if (n->linked) {
+			ret.nodes_image[i]->linked = regular(n->linked);
+		}
+	}
+
+	for (auto p : inputs_to_sim) {
+		ret.inputs_to_sim.push_back(inputs[to_unsigned(p->x)]);
+	}
+	for (auto p : regulars_to_sim) {
+		ret.regulars_to_sim.push_back(regular(p));
+	}
+	for (auto p : numerics_to_sim) {
+		ret.numerics_to_sim.push_back(numerics[to_unsigned(p->x)]);
+	}
+	for (auto p : images_to_sim) {
+		ret.images_to_sim.push_back(images[to_unsigned(p->x)]);
+	}
+	ret.allT21 = allT21;
+	ret.unrolled_nodes = unrolled_nodes;
+
+	return ret;
+}
+
+field::snapshot field::save() const {
+	snapshot s;
+	for (auto p : inputs_to_sim) {
+		s.inputs.push_back(p->save());
+	}
+	for (auto p : regulars_to_sim) {
+		if (p->type == node::T21) {
+			s.t21s.push_back(static_cast<const T21*>(p)->save());
+		} else {
+			s.t30s.push_back(static_cast<const T30*>(p)->save());
+		}
+	}
+	for (auto p : numerics_to_sim) {
+		s.numerics.push_back(p->save());
+	}
+	for (auto p : images_to_sim) {
+		s.images.push_back(p->save());
+	}
+	return s;
+}
 
-	ret.finalize_nodes();
+void field::restore(const snapshot& s) {
+	for (auto [p, i] : kblib::enumerate(inputs_to_sim)) {
+		p->restore(s.inputs[i]);
+	}
+	auto t21 = s.t21s.begin();
+	auto t30 = s.t30s.begin();
+	for (auto p : regulars_to_sim) {
+		if (p->type == node::T21) {
+			static_cast<T21*>(p)->restore(*t21++);
+		} else {
+			static_cast<T30*>(p)->restore(*t30++);
+		}
+	}
+	for (auto [p, i] : kblib::enumerate(numerics_to_sim)) {
+		p->restore(s.numerics[i]);
+	}
+	for (auto [p, i] : kblib::enumerate(images_to_sim)) {
+		p->restore(s.images[i]);
+	}
+}
 
+std::string field::changed_state(snapshot& prev) const {
+	std::string ret;
+	// only the nodes that changed are copied
+	auto compare = [&](const auto& n, auto& saved) {
+		if (not n->matches(saved)) {
+			ret += n->state();
+			ret += '\n';
+			saved = n->save();
+		}
+	};
+	for (auto [p, i] : kblib::enumerate(inputs_to_sim)) {
+		compare(p, prev.inputs[i]);
+	}
+	auto t21 = prev.t21s.begin();
+	auto t30 = prev.t30s.begin();
+	for (auto p : regulars_to_sim) {
+		if (p->type == node::T21) {
+			compare(static_cast<const T21*>(p), *t21++);
+		} else {
+			compare(static_cast<const T30*>(p), *t30++);
+		}
+	}
+	for (auto [p, i] : kblib::enumerate(numerics_to_sim)) {
+		compare(p, prev.numerics[i]);
+	}
+	for (auto [p, i] : kblib::enumerate(images_to_sim)) {
+		compare(p, prev.images[i]);
+	}
 	return ret;
 }
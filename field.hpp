@@ -25,6 +25,22 @@
 #include "node.hpp"
 
 #include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+/// Fields with at most this many simulated regular nodes get step kernels with
+/// the node loops unrolled, which covers every builtin layout
+constexpr std::size_t max_unrolled_nodes = 12;
+
+/// Fields are split between threads only if each one gets at least this many
+/// simulated regular nodes, below that the barriers cost more than the steps
+constexpr std::size_t min_nodes_per_thread = 64;
+
+/// Tag selecting a step kernel: whether all simulated regular nodes are T21,
+/// and how many of them there are, or 0 for the generic loops
+template <bool allT21, std::size_t N>
+struct step_kernel {};
 
 /// nodes that are candidates to be simulated
 inline bool useful(const node* n) {
@@ -73,6 +89,8 @@ class field {
 				case node::T21:
 					nodes_regular.push_back(std::make_unique<T21>(
 					    static_cast<int>(x), static_cast<int>(y)));
+					nodes_t21.push_back(
+					    static_cast<T21*>(nodes_regular.back().get()));
 					break;
 				case node::T30: {
 					nodes_regular.push_back(std::make_unique<T30>(
@@ -137,19 +155,54 @@ class field {
 
 	/// Advance the field one full cycle (step and finalize)
 	[[gnu::always_inline]] inline bool step() {
+		auto debug = log_debug();
+		return step(debug);
+	}
+	/// Advance the field one full cycle, sending the debug output to a
+	/// specific sink
+	template <typename Log>
+	[[gnu::always_inline]] inline bool step(Log& debug) {
 		if (allT21) {
-			return do_step<true>();
+			return do_step<true, 0>(debug);
 		} else {
-			return do_step<false>();
+			return do_step<false, 0>(debug);
 		}
 	}
+	/// Advance the field one full cycle with a kernel obtained from
+	/// visit_kernel or visit_generic_kernel
+	template <bool allT21, std::size_t N, typename Log>
+	[[gnu::always_inline]] inline bool step(step_kernel<allT21, N>,
+	                                        Log& debug) {
+		return do_step<allT21, N>(debug);
+	}
 
-	template <bool allT21>
-	[[gnu::always_inline]] inline bool do_step() {
-		auto debug = log_debug();
+	/// Call fn with the step_kernel tag matching this field, so that a whole
+	/// simulation loop can be instantiated for it
+	void visit_kernel(auto&& fn) {
+		if (allT21) {
+			visit_kernel<true>(fn);
+		} else {
+			visit_kernel<false>(fn);
+		}
+	}
+	/// Like visit_kernel, but never with an unrolled kernel, for the loops
+	/// with a log, which would otherwise instantiate one loop per node count
+	void visit_generic_kernel(auto&& fn) {
+		if (allT21) {
+			fn(step_kernel<true, 0>{});
+		} else {
+			fn(step_kernel<false, 0>{});
+		}
+	}
+
+	template <bool allT21, std::size_t N, typename Log>
+	[[gnu::always_inline]] inline bool do_step(Log& debug) {
+		if constexpr (event_sink<Log>) {
+			debug.record({.kind = trace_event::field_step});
+		}
 		debug << "Field step\n";
 		// evaluate code
-		for (auto& p : regulars_to_sim) {
+		for_each_regular<N>([&](regular_node* p) {
 			if constexpr (allT21) {
 				static_cast<T21*>(p)->step(debug);
 			} else {
@@ -160,8 +213,14 @@ class field {
 					static_cast<T30*>(p)->step(debug);
 				}
 			}
+		});
+		if constexpr (event_sink<Log>) {
+			debug.record({.kind = trace_event::phase});
 		}
 		debug << '\n';
+#if TIS_ENABLE_PROFILE
+		profile_step();
+#endif
 
 		// run input nodes, they are only read from, so effectively do a finalize
 		for (auto& p : inputs_to_sim) {
@@ -175,11 +234,14 @@ class field {
 		for (auto& p : images_to_sim) {
 			active |= p->step(debug);
 		}
+		if constexpr (event_sink<Log>) {
+			debug.record({.kind = trace_event::phase});
+		}
 		debug << '\n';
 
 		// execute writes
 		// this is a separate step to ensure a consistent propagation delay
-		for (auto& p : regulars_to_sim) {
+		for_each_regular<N>([&](regular_node* p) {
 			if constexpr (allT21) {
 				static_cast<T21*>(p)->finalize(debug);
 			} else {
@@ -189,9 +251,66 @@ class field {
 					static_cast<T30*>(p)->finalize(debug);
 				}
 			}
+		});
+		return active;
+	}
+
+	/// Split of the simulated regular nodes for stepping a cycle with several
+	/// threads: each thread steps its nodes in step, then one thread steps
+	/// serial, in order, and the IO nodes, then each thread finalizes its nodes
+	/// in finalize. A node is serial if it's linked to a node of another
+	/// thread, or reads from a node that can offer a value to several readers
+	/// (a T30 or a MOV to ANY), as the first reader in the serial order gets it.
+	struct parallel_plan {
+		std::vector<std::vector<regular_node*>> step;
+		std::vector<regular_node*> serial;
+		std::vector<std::vector<regular_node*>> finalize;
+	};
+	/// Split the nodes in contiguous runs for at most threads threads, with at
+	/// least min_nodes nodes each. The fuzzer lowers min_nodes to check plans
+	/// on small fields.
+	parallel_plan plan_parallel(std::size_t threads,
+	                            std::size_t min_nodes = min_nodes_per_thread) const;
+
+	/// The phases of step(), without a log, for the nodes of a parallel_plan
+	static void step_regulars(std::span<regular_node* const> nodes) {
+		null_logger debug;
+		for (auto p : nodes) {
+			if (p->type == node::T21) [[likely]] {
+				static_cast<T21*>(p)->step(debug);
+			} else {
+				static_cast<T30*>(p)->step(debug);
+			}
+		}
+	}
+	/// The IO phase of step(), after all the regular nodes have stepped
+	bool step_io() {
+		null_logger debug;
+#if TIS_ENABLE_PROFILE
+		profile_step();
+#endif
+		for (auto& p : inputs_to_sim) {
+			p->finalize(debug);
+		}
+		bool active = false;
+		for (auto& p : numerics_to_sim) {
+			active |= p->step(debug);
+		}
+		for (auto& p : images_to_sim) {
+			active |= p->step(debug);
 		}
 		return active;
 	}
+	static void finalize_regulars(std::span<regular_node* const> nodes) {
+		null_logger debug;
+		for (auto p : nodes) {
+			if (p->type == node::T21) [[likely]] {
+				static_cast<T21*>(p)->finalize(debug);
+			} else {
+				static_cast<T30*>(p)->finalize(debug);
+			}
+		}
+	}
 
 	/// Write the full state of all nodes, similar to what the game displays
 	/// in its debugger but in linear order
@@ -220,14 +339,35 @@ class field {
 	std::size_t instructions() const;
 	std::size_t nodes_used() const;
 
+#if TIS_ENABLE_PROFILE
+	/// Serialize the utilization counters as heatmaps aligned with layout()
+	std::string profile_report(bool colored) const;
+#endif
+
 	/// Serialize human-readable layout
 	std::string layout() const;
 
 	/// must be called after code loading
 	void finalize_nodes();
-	/// returns field with all nodes cloned and resetted
+	/// returns field with all nodes cloned and resetted, without test data,
+	/// with the links and simulation lists of this one
 	field clone() const;
 
+	/// The state of the simulated nodes at some point of a test
+	struct snapshot {
+		std::vector<input_node::saved_state> inputs;
+		std::vector<T21::saved_state> t21s;
+		std::vector<T30::saved_state> t30s;
+		std::vector<num_output::saved_state> numerics;
+		std::vector<image_output::saved_state> images;
+	};
+	snapshot save() const;
+	/// Go back (or forward) to the point of the current test where s was saved
+	void restore(const snapshot& s);
+	/// Like state(), but only the nodes whose state is not the one saved in
+	/// prev, which is updated to the current state
+	std::string changed_state(snapshot& prev) const;
+
 	/// returns the node at the (x,y) coordinates, or nullptr if such a node
 	/// doesn't exist or is not useful
 	regular_node* useful_node_at(std::size_t x, std::size_t y) {
@@ -240,14 +380,9 @@ class field {
 	}
 	// returns the ith programmable (T21) node
 	T21* node_by_index(std::size_t i) {
-		for (auto& n : nodes_regular) {
-			auto p = n.get();
-			if (p->type == node::T21 and i-- == 0) {
-				return static_cast<T21*>(p);
-			}
-		}
-		return nullptr;
+		return i < nodes_t21.size() ? nodes_t21[i] : nullptr;
 	}
+	std::size_t t21_count() const noexcept { return nodes_t21.size(); }
 
 	const auto& inputs() const noexcept { return nodes_input; }
 	const auto& regulars() const noexcept { return nodes_regular; }
@@ -267,6 +402,8 @@ class field {
 	std::vector<std::unique_ptr<regular_node>> nodes_regular;
 	std::vector<std::unique_ptr<num_output>> nodes_numeric;
 	std::vector<std::unique_ptr<image_output>> nodes_image;
+	/// the T21 nodes of nodes_regular, in order, for node_by_index
+	std::vector<T21*> nodes_t21;
 
 	std::vector<input_node*> inputs_to_sim;
 	std::vector<regular_node*> regulars_to_sim;
@@ -281,8 +418,58 @@ class field {
 		return nodes_regular.size() / width;
 	}
 	bool allT21 = true;
+	/// number of simulated regular nodes if the unrolled kernels apply, else 0
+	std::size_t unrolled_nodes{};
+
+	template <bool allT21>
+	void visit_kernel(auto& fn) {
+		[&]<std::size_t... N>(std::index_sequence<N...>) {
+			// compiles to a jump table on the node count
+			((unrolled_nodes == N and (fn(step_kernel<allT21, N>{}), true))
+			 or ...);
+		}(std::make_index_sequence<max_unrolled_nodes + 1>{});
+	}
+
+	/// Apply fn to every simulated regular node, with the loop unrolled if N
+	/// is not 0
+	template <std::size_t N>
+	[[gnu::always_inline]] inline void for_each_regular(auto&& fn) {
+		if constexpr (N == 0) {
+			for (auto p : regulars_to_sim) {
+				fn(p);
+			}
+		} else {
+			assert(regulars_to_sim.size() == N);
+			auto nodes = regulars_to_sim.data();
+			[&]<std::size_t... I>(std::index_sequence<I...>) {
+				(fn(nodes[I]), ...);
+			}(std::make_index_sequence<N>{});
+		}
+	}
+#if TIS_ENABLE_PROFILE
+	std::size_t profile_cycles{};
+
+	/// Sample the activity of every simulated node, after the step phase
+	void profile_step() {
+		++profile_cycles;
+		for (auto p : regulars_to_sim) {
+			if (p->type == node::T21) {
+				++p->profile.cycles[to_unsigned(
+				    etoi(static_cast<T21*>(p)->activity_state()))];
+			} else {
+				// a T30 has no instructions, it's either offering a value to
+				// its neighbors or empty
+				auto depth = static_cast<T30*>(p)->depth();
+				++p->profile.cycles[to_unsigned(
+				    etoi(depth ? activity::write : activity::idle))];
+				p->profile.peak_depth = std::max(p->profile.peak_depth, depth);
+			}
+		}
+	}
+#endif
 
-	bool search_for_output(const regular_node*);
+	/// for each node in nodes_regular, whether it can affect an output
+	std::vector<bool> connected_to_output();
 };
 
 #endif // FIELD_HPP
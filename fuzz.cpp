@@ -0,0 +1,325 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "fuzz.hpp"
+#include "builtin_specs.hpp"
+#include "field.hpp"
+#include "logger.hpp"
+#include "parser.hpp"
+#include "runner.hpp"
+
+#include <array>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// A random level and solution, with the code kept as lines so that it can be
+/// minimized
+struct fuzz_case {
+	dynamic_layout_spec layout;
+	/// lines of each T21, in the order of the @N labels
+	std::vector<std::vector<std::string>> code;
+	single_test test;
+
+	std::string source() const {
+		std::string ret;
+		for (auto [lines, i] : kblib::enumerate(code)) {
+			append(ret, '@', i, '\n');
+			for (const auto& line : lines) {
+				append(ret, line, '\n');
+			}
+			ret += '\n';
+		}
+		return ret;
+	}
+};
+
+/// Discards the debug text of the kernels with a log, which is formatted
+/// whatever the log level, so that the text sinks are checked too
+std::ostream discarded_log(nullptr);
+
+/// The step kernels that must agree. The reference goes through the text
+/// debug sink and the generic node dispatch, like the original simulator.
+/// Without TIS_ENABLE_DEBUG, the debug sinks format nothing.
+/// The parallel kernel splits any field with two nodes or more between
+/// threads, though run() only does it for large ones.
+constexpr std::array<std::pair<std::string_view, bool (*)(field&)>, 5> kernels{{
+    {"reference",
+     [](field& f) {
+	     log_redirect redirect(discarded_log, log_level::debug);
+	     auto debug = log_debug();
+	     return f.step(step_kernel<false, 0>{}, debug);
+     }},
+    {"generic",
+     [](field& f) {
+	     null_logger debug;
+	     return f.step(debug);
+     }},
+    {"unrolled",
+     [](field& f) {
+	     null_logger debug;
+	     bool active{};
+	     f.visit_kernel([&](auto kernel) { active = f.step(kernel, debug); });
+	     return active;
+     }},
+    {"generic with log",
+     [](field& f) {
+	     log_redirect redirect(discarded_log, log_level::debug);
+	     auto debug = log_debug();
+	     bool active{};
+	     f.visit_generic_kernel(
+	         [&](auto kernel) { active = f.step(kernel, debug); });
+	     return active;
+     }},
+    {"parallel",
+     [](field& f) {
+	     score sc{};
+	     return detail::run_loop_parallel(f, sc, 1, f.plan_parallel(3, 1));
+     }},
+}};
+
+fuzz_case random_case(std::mt19937_64& rng) {
+	auto pick = [&](std::size_t n) {
+		return std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+	};
+	auto chance = [&](double p) { return std::bernoulli_distribution(p)(rng); };
+	// small values make the conditional jumps and JRO interesting
+	auto value = [&]() -> word_t {
+		return chance(.5) ? to_word(static_cast<int>(pick(11)) - 5)
+		                  : to_word(static_cast<int>(pick(1999)) - 999);
+	};
+
+	fuzz_case c;
+	auto width = 1 + pick(4);
+	auto height = 1 + pick(3);
+	std::size_t t21_count{};
+	c.layout.nodes.resize(height);
+	for (auto& row : c.layout.nodes) {
+		row.resize(width);
+		for (auto& type : row) {
+			if (chance(.7)) {
+				type = node::T21;
+				++t21_count;
+			} else {
+				type = chance(.5) ? node::T30 : node::Damaged;
+			}
+		}
+	}
+	c.layout.inputs.resize(width, node::null);
+	c.layout.outputs.resize(width, node::null);
+	for (auto x : range(width)) {
+		if (chance(.4)) {
+			c.layout.inputs[x] = node::in;
+			auto& in = c.test.inputs.emplace_back(pick(40));
+			std::ranges::generate(in, value);
+		}
+		if (chance(.4)) {
+			c.layout.outputs[x] = node::out;
+			auto& out = c.test.n_outputs.emplace_back(pick(40));
+			std::ranges::generate(out, value);
+		}
+	}
+
+	constexpr std::array<std::string_view, 8> ports{
+	    "ACC", "NIL", "LEFT", "RIGHT", "UP", "DOWN", "ANY", "LAST"};
+	auto src = [&] {
+		return chance(.4) ? std::to_string(value()) : std::string(ports[pick(8)]);
+	};
+	auto dst = [&] { return std::string(ports[pick(8)]); };
+	c.code.resize(t21_count);
+	for (auto& lines : c.code) {
+		lines.resize(chance(.15) ? 0 : 1 + pick(10));
+		std::vector<std::string> labels;
+		for (auto [line, i] : kblib::enumerate(lines)) {
+			if (chance(.3)) {
+				labels.push_back(concat('L', i));
+				line = concat('L', i, ": ");
+			}
+		}
+		for (auto& line : lines) {
+			auto op = pick(100);
+			if (op < 35) {
+				append(line, "MOV ", src(), ", ", dst());
+			} else if (op < 45) {
+				append(line, "ADD ", src());
+			} else if (op < 52) {
+				append(line, "SUB ", src());
+			} else if (op < 60) {
+				append(line, "JRO ", src());
+			} else if (op < 75 and not labels.empty()) {
+				constexpr std::array<std::string_view, 5> jumps{"JMP", "JEZ", "JNZ",
+				                                                "JGZ", "JLZ"};
+				append(line, jumps[pick(5)], ' ', labels[pick(labels.size())]);
+			} else if (op < 82) {
+				line += "SWP";
+			} else if (op < 89) {
+				line += "SAV";
+			} else if (op < 95) {
+				line += "NEG";
+			} else if (op < 99) {
+				line += "NOP";
+			} else {
+				line += "HCF";
+			}
+		}
+	}
+	return c;
+}
+
+field make_field(const fuzz_case& c) {
+	field f(c.layout, def_T30_size);
+	parse_code(f, c.source(), def_T21_size);
+	set_expected(f, c.test);
+	return f;
+}
+
+struct divergence {
+	std::size_t cycle;
+	std::string_view kernel;
+	std::string expected;
+	std::string actual;
+};
+
+/// @returns the first cycle after which a kernel's state differs from the
+/// reference
+/// @throws std::invalid_argument if the code doesn't assemble
+std::optional<divergence> compare(const fuzz_case& c, std::size_t cycles) {
+	std::vector<field> fields;
+	fields.reserve(kernels.size());
+	while (fields.size() != kernels.size()) {
+		fields.push_back(make_field(c));
+	}
+	for (auto cycle : range(std::size_t{1}, cycles + 1)) {
+		std::string reference;
+		bool halted{};
+		for (auto [k, i] : kblib::enumerate(kernels)) {
+			std::string state;
+			try {
+				bool active = k.second(fields[i]);
+				state = concat("active: ", active, '\n', fields[i].state());
+			} catch (const hcf_exception& e) {
+				state = concat("HCF at ", e.x, ',', e.y, ':', e.line, '\n');
+				halted = true;
+			}
+			if (i == 0) {
+				reference = std::move(state);
+			} else if (state != reference) {
+				return divergence{cycle, k.first, std::move(reference),
+				                  std::move(state)};
+			}
+		}
+		if (halted) {
+			break;
+		}
+	}
+	return std::nullopt;
+}
+
+/// Remove lines and test values from c while the kernels still diverge, d is
+/// updated to the last divergence found
+fuzz_case minimize(fuzz_case c, divergence& d) {
+	auto still_diverges = [&](const fuzz_case& t) {
+		try {
+			if (auto r = compare(t, d.cycle)) {
+				d = std::move(*r);
+				return true;
+			}
+		} catch (const std::invalid_argument&) {
+			// removed a line with a label still in use
+		}
+		return false;
+	};
+	auto shrink = [&](auto get) {
+		bool progress{};
+		for (auto i : range(get(c).size())) {
+			for (auto j = get(c)[i].size(); j-- != 0;) {
+				auto t = c;
+				auto& v = get(t)[i];
+				v.erase(v.begin() + static_cast<std::ptrdiff_t>(j));
+				if (still_diverges(t)) {
+					c = std::move(t);
+					progress = true;
+				}
+			}
+		}
+		return progress;
+	};
+	auto code = [](fuzz_case& t) -> auto& { return t.code; };
+	auto inputs = [](fuzz_case& t) -> auto& { return t.test.inputs; };
+	auto outputs = [](fuzz_case& t) -> auto& { return t.test.n_outputs; };
+	while (shrink(code) | shrink(inputs) | shrink(outputs)) {
+	}
+	return c;
+}
+
+} // namespace
+
+bool fuzz_kernels(std::uint64_t seed, std::uint64_t cases, std::size_t cycles,
+                  std::ostream& os) {
+	for (auto i : range(cases)) {
+		std::mt19937_64 rng(seed + i);
+		auto c = random_case(rng);
+		auto d = compare(c, cycles);
+		if ((i + 1) % 1000 == 0) {
+			log_info(i + 1, " cases compared");
+		}
+		if (not d) {
+			continue;
+		}
+		log_notice("Kernel ", d->kernel, " diverged at cycle ", d->cycle,
+		           " for seed ", seed + i, ", minimizing");
+		c = minimize(std::move(c), *d);
+
+		os << "kernel " << kblib::quoted(d->kernel)
+		   << " diverged from the reference at cycle " << d->cycle
+		   << " (reproduce with --seed " << seed + i << " --cases 1)\nlayout:\n";
+		for (const auto& row : c.layout.nodes) {
+			for (auto t : row) {
+				os << (t == node::T21 ? 'C' : t == node::T30 ? 'M' : 'X');
+			}
+			os << '\n';
+		}
+		os << "inputs:";
+		for (auto t : c.layout.inputs) {
+			os << (t == node::in ? " I" : " -");
+		}
+		os << "\noutputs:";
+		for (auto t : c.layout.outputs) {
+			os << (t == node::out ? " O" : " -");
+		}
+		os << "\n\n" << c.source();
+		for (const auto& in : c.test.inputs) {
+			os << "input: ";
+			write_list(os, in) << '\n';
+		}
+		for (const auto& out : c.test.n_outputs) {
+			os << "expected output: ";
+			write_list(os, out) << '\n';
+		}
+		os << "\nreference state:\n" << d->expected << '\n'
+		   << d->kernel << " state:\n" << d->actual;
+		return false;
+	}
+	log_notice(cases, " cases compared, no divergence");
+	return true;
+}
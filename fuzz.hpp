@@ -0,0 +1,31 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef FUZZ_HPP
+#define FUZZ_HPP
+
+#include <cstdint>
+#include <iosfwd>
+
+/// Run cases random layouts, programs and inputs through every step kernel
+/// for up to cycles cycles each, comparing the whole field state after each
+/// cycle. The first divergence is minimized and printed to os.
+/// @returns true if all the kernels agreed on every case
+bool fuzz_kernels(std::uint64_t seed, std::uint64_t cases, std::size_t cycles,
+                  std::ostream& os);
+
+#endif // FUZZ_HPP
@@ -0,0 +1,91 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+// Build step: writes the fixed tests of every builtin level as the C++
+// initializer that static_suites.cpp embeds
+
+#include "levels.hpp"
+
+#include <fstream>
+#include <iostream>
+
+// the generator is built without static_suites.cpp, since it's what writes
+// its tables, so the fixed tests come straight from the generators
+const std::array<single_test, 3>& builtin_level::static_suite() {
+	static std::array<single_test, 3> suite;
+	suite = make_static_suite();
+	return suite;
+}
+
+static void write_words(std::ostream& out, const std::vector<word_vec>& vecs) {
+	out << "std::vector<word_vec>{";
+	for (const auto& v : vecs) {
+		out << "word_vec{";
+		for (auto w : v) {
+			out << w << ',';
+		}
+		out << "},";
+	}
+	out << '}';
+}
+
+static void write_images(std::ostream& out, const std::vector<image_t>& imgs) {
+	out << "std::vector<image_t>{";
+	for (const auto& img : imgs) {
+		// one digit per pixel, the value of its color
+		out << "image_t({";
+		for (auto y : range(img.height())) {
+			out << "u\"";
+			for (auto x : range(img.width())) {
+				out << static_cast<int>(img[x, y].val);
+			}
+			out << "\",";
+		}
+		out << "}, u\"01234\"),";
+	}
+	out << '}';
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::cerr << "Usage: " << argv[0] << " OUTPUT\n";
+		return 1;
+	}
+	std::ofstream out(argv[1], std::ios::trunc);
+	out << "// Generated by gen_static_suites, do not edit\n";
+	for (auto id : range(builtin_levels_num)) {
+		builtin_level l(static_cast<uint>(id));
+		out << "{{ // " << builtin_layouts[id].segment << ' '
+		    << builtin_layouts[id].name << '\n';
+		for (const auto& test : l.static_suite()) {
+			out << "single_test{";
+			write_words(out, test.inputs);
+			out << ",\n";
+			write_words(out, test.n_outputs);
+			out << ",\n";
+			write_images(out, test.i_outputs);
+			out << "},\n";
+		}
+		out << "}},\n";
+	}
+	if (not out.flush()) {
+		std::cerr << "Cannot write " << argv[1] << '\n';
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,230 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include "field.hpp"
+#include "parser.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <string>
+
+/// Distribution of cycle counts, in buckets exact up to 512 cycles and 1/256
+/// of a power of two wide above that, so percentiles are within 0.4%. Min and
+/// max are exact. Not thread safe, each thread is meant to fill its own and merge
+/// them at the end.
+class cycle_histogram {
+ public:
+	void record(std::size_t cycles) noexcept {
+		++buckets[index(cycles)];
+		++n;
+		min_ = std::min(min_, cycles);
+		max_ = std::max(max_, cycles);
+	}
+
+	cycle_histogram& operator+=(const cycle_histogram& o) noexcept {
+		for (auto i : range(buckets.size())) {
+			buckets[i] += o.buckets[i];
+		}
+		n += o.n;
+		min_ = std::min(min_, o.min_);
+		max_ = std::max(max_, o.max_);
+		return *this;
+	}
+
+	/// The counts on one line, for checkpoints: the number of values, min,
+	/// max, and index:count for each bucket that isn't empty
+	void write(std::ostream& os) const {
+		os << n << ' ' << min_ << ' ' << max_;
+		for (auto i : range(buckets.size())) {
+			if (buckets[i] != 0) {
+				os << ' ' << i << ':' << buckets[i];
+			}
+		}
+	}
+	/// Add the counts written by write
+	/// @returns false if they are invalid
+	bool read(std::istream& is) {
+		cycle_histogram h;
+		if (not (is >> h.n >> h.min_ >> h.max_)) {
+			return false;
+		}
+		std::size_t i;
+		char colon;
+		while (is >> i >> colon) {
+			if (colon != ':' or i >= buckets.size()
+			    or not (is >> h.buckets[i])) {
+				return false;
+			}
+		}
+		if (not is.eof()) {
+			return false;
+		}
+		*this += h;
+		return true;
+	}
+
+	std::uint64_t count() const noexcept { return n; }
+	std::size_t min() const noexcept { return min_; }
+	std::size_t max() const noexcept { return max_; }
+
+	/// the cycle count at or below which a fraction q of the values fall,
+	/// rounded down to its bucket
+	std::size_t percentile(double q) const noexcept {
+		auto target = static_cast<std::uint64_t>(q * static_cast<double>(n));
+		std::uint64_t seen{};
+		for (auto i : range(buckets.size())) {
+			seen += buckets[i];
+			if (seen > target) {
+				return std::clamp(lower_bound(i), min_, max_);
+			}
+		}
+		return max_;
+	}
+
+	/// min, p50, p90, p99 and max on one line, then the values split in at
+	/// most rows ranges of the same width, with a bar for each
+	std::string report(std::size_t rows = 10) const {
+		if (n == 0) {
+			return "no tests\n";
+		}
+		std::string ret = concat(n, " tests, min ", min_, " p50 ", percentile(.5),
+		                         " p90 ", percentile(.9), " p99 ",
+		                         percentile(.99), " max ", max_, '\n');
+		auto width = (max_ - min_) / rows + 1;
+		std::vector<std::uint64_t> row_counts((max_ - min_) / width + 1);
+		for (auto i : range(buckets.size())) {
+			if (buckets[i] != 0) {
+				auto v = std::clamp(lower_bound(i), min_, max_);
+				row_counts[(v - min_) / width] += buckets[i];
+			}
+		}
+		auto peak = std::ranges::max(row_counts);
+		constexpr std::uint64_t bar_width = 40;
+		auto pad = [](std::size_t v) {
+			auto s = std::to_string(v);
+			return std::string(s.size() < 7 ? 7 - s.size() : 0, ' ') + s;
+		};
+		for (auto [c, i] : kblib::enumerate(row_counts)) {
+			auto begin = min_ + i * width;
+			append(ret, "  ", pad(begin), " .. ", pad(begin + width - 1), ' ',
+			       std::string((c * bar_width + peak - 1) / peak, '#'), ' ', c,
+			       '\n');
+		}
+		return ret;
+	}
+
+ private:
+	static constexpr unsigned sub_bits = 8;
+	static constexpr std::size_t exact = std::size_t{2} << sub_bits;
+	static constexpr std::size_t bucket_count
+	    = exact
+	      + (std::numeric_limits<std::size_t>::digits - sub_bits - 1)
+	            * (exact / 2);
+
+	static std::size_t index(std::size_t v) noexcept {
+		if (v < exact) {
+			return v;
+		}
+		// v >> shift has sub_bits + 1 bits, the top one is implied
+		auto shift = static_cast<unsigned>(std::bit_width(v)) - sub_bits - 1;
+		return exact + (shift - 1) * (exact / 2) + ((v >> shift) - exact / 2);
+	}
+	static std::size_t lower_bound(std::size_t i) noexcept {
+		if (i < exact) {
+			return i;
+		}
+		auto shift = (i - exact) / (exact / 2) + 1;
+		auto mantissa = (i - exact) % (exact / 2) + exact / 2;
+		return mantissa << shift;
+	}
+
+	std::array<std::uint64_t, bucket_count> buckets{};
+	std::uint64_t n{};
+	std::size_t min_{std::numeric_limits<std::size_t>::max()};
+	std::size_t max_{};
+};
+
+/// Cycle counts of the random tests by outcome
+struct cycle_stats {
+	cycle_histogram passed;
+	/// all at the cycle limit, so only counted
+	std::uint64_t timeouts{};
+	/// failures before the limit, by the first wrong output node
+	std::map<int, cycle_histogram> failed;
+
+	void record(const field& f, const score& sc, std::size_t cycles_limit) {
+		if (sc.validated) {
+			passed.record(sc.cycles);
+		} else if (sc.cycles == cycles_limit) {
+			++timeouts;
+		} else {
+			failed[first_wrong_output(f)].record(sc.cycles);
+		}
+	}
+
+	cycle_stats& operator+=(const cycle_stats& o) {
+		passed += o.passed;
+		timeouts += o.timeouts;
+		for (const auto& [x, h] : o.failed) {
+			failed[x] += h;
+		}
+		return *this;
+	}
+
+	std::string report() const {
+		std::string ret = concat("passed: ", passed.report());
+		if (timeouts != 0) {
+			append(ret, "timeouts: ", timeouts, " tests\n");
+		}
+		for (const auto& [x, h] : failed) {
+			if (x == -1) {
+				append(ret, "failed: ", h.report());
+			} else {
+				append(ret, "failed at output ", x, ": ", h.report());
+			}
+		}
+		return ret;
+	}
+
+ private:
+	/// x of the first output node that didn't validate, -1 if none (HCF)
+	static int first_wrong_output(const field& f) {
+		for (auto& p : f.numerics()) {
+			if (not p->valid()) {
+				return p->x;
+			}
+		}
+		for (auto& p : f.images()) {
+			if (not p->valid()) {
+				return p->x;
+			}
+		}
+		return -1;
+	}
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,124 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "inspect.hpp"
+#include "logger.hpp"
+#include "runner.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+timeline::timeline(field& f, std::size_t cycles_limit, std::size_t interval)
+    : f(&f)
+    , interval(interval) {
+	if (interval == 0) {
+		throw std::invalid_argument{"Snapshot interval must not be zero"};
+	}
+	snapshots.push_back(f.save());
+	bool active = true;
+	// the same end conditions as run()
+	while (active and last < cycles_limit and not stop_requested) {
+		++last;
+		try {
+			active = step();
+		} catch (const hcf_exception& e) {
+			hcf_ = e;
+			break;
+		}
+		if (last % interval == 0) {
+			snapshots.push_back(f.save());
+		}
+	}
+	current = last;
+}
+
+void timeline::seek(std::size_t c) {
+	c = std::min(c, last);
+	auto i = std::min(c / interval, snapshots.size() - 1);
+	if (c < current or i * interval > current) {
+		f->restore(snapshots[i]);
+		current = i * interval;
+	}
+	while (current < c) {
+		++current;
+		try {
+			step();
+		} catch (const hcf_exception&) {
+			// only in the last cycle, as recorded in hcf_
+		}
+	}
+}
+
+bool timeline::step() {
+	null_logger debug;
+	return f->step(debug);
+}
+
+void inspect(field& f, std::size_t cycles_limit, std::size_t interval,
+             std::istream& in, std::ostream& os) {
+	auto start = std::chrono::steady_clock::now();
+	timeline t(f, cycles_limit, interval);
+	log_info("Recorded ", t.end(), " cycles in ",
+	         std::chrono::duration<double>(std::chrono::steady_clock::now()
+	                                       - start)
+	             .count(),
+	         "s");
+	os << "The test ran for " << t.end() << " cycles";
+	if (auto& e = t.hcf()) {
+		os << ", aborted by HCF (node " << e->x << ',' << e->y << ':' << e->line
+		   << ')';
+	}
+	os << ".\nEnter a cycle number, +N or -N to move by N cycles, or q to "
+	      "quit.\n";
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::string_view cmd = line;
+		cmd.remove_prefix(std::min(cmd.find_first_not_of(" \t\r"), cmd.size()));
+		cmd = cmd.substr(0, cmd.find_last_not_of(" \t\r") + 1);
+		if (cmd.empty()) {
+			continue;
+		} else if (cmd == "q") {
+			break;
+		}
+		try {
+			if (cmd[0] == '+' or cmd[0] == '-') {
+				auto n = cmd.size() == 1
+				             ? std::size_t{1}
+				             : kblib::parse_integer<std::size_t>(cmd.substr(1));
+				if (cmd[0] == '+') {
+					t.seek(t.cycle() + std::min(n, t.end()));
+				} else {
+					t.seek(t.cycle() - std::min(n, t.cycle()));
+				}
+			} else {
+				t.seek(kblib::parse_integer<std::size_t>(cmd));
+			}
+		} catch (const std::exception&) {
+			os << "Unknown command " << kblib::quoted(cmd) << '\n';
+			continue;
+		}
+		os << "cycle " << t.cycle() << ":\n" << f.state() << std::flush;
+	}
+}
@@ -0,0 +1,69 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef INSPECT_HPP
+#define INSPECT_HPP
+
+#include "field.hpp"
+#include "node.hpp"
+
+#include <cstddef>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+/// A test run on a field, with snapshots every interval cycles, so that the
+/// field can be set to any cycle by restoring the last snapshot before it and
+/// simulating at most interval cycles
+class timeline {
+ public:
+	/// Run the test set on f until it ends, like run() would. f must outlive
+	/// the timeline and is left at the last cycle.
+	timeline(field& f, std::size_t cycles_limit, std::size_t interval);
+
+	/// Set the field to its state after cycle c, or to the last cycle if the
+	/// test ended before
+	void seek(std::size_t c);
+
+	/// The cycle the field is at, 0 before the first step
+	std::size_t cycle() const noexcept { return current; }
+	/// The last cycle of the test
+	std::size_t end() const noexcept { return last; }
+	/// Set if the test was aborted by HCF in its last cycle, the field is then
+	/// left as the HCF found it
+	const std::optional<hcf_exception>& hcf() const noexcept { return hcf_; }
+
+ private:
+	/// @throws hcf_exception
+	bool step();
+
+	field* f;
+	std::size_t interval;
+	/// snapshots[i] is the state after cycle i * interval
+	std::vector<field::snapshot> snapshots;
+	std::size_t current{};
+	std::size_t last{};
+	std::optional<hcf_exception> hcf_;
+};
+
+/// Run the test set on f and print its state at the cycles asked for on in,
+/// one command per line: a cycle number, +N or -N to move by N cycles (1 if
+/// N is omitted), or q to quit
+void inspect(field& f, std::size_t cycles_limit, std::size_t interval,
+             std::istream& in, std::ostream& os);
+
+#endif // INSPECT_HPP
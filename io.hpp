@@ -21,6 +21,7 @@
 #include "image.hpp"
 #include "logger.hpp"
 #include "node.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
@@ -30,16 +31,26 @@ struct input_node final : node {
 	input_node(int x, int y)
 	    : node(x, y, type_t::in) {}
 
-	void reset(word_vec inputs_) noexcept {
+	/// inputs_ must outlive the test
+	void reset(word_view inputs_) noexcept {
 		write_word = word_empty;
 		write_port = port::down;
-		inputs = std::move(inputs_);
+		inputs = inputs_;
 		idx = 0;
 		s = activity::idle;
 	}
 
 	/// Complete write or reload
-	[[gnu::always_inline]] inline void finalize(logger& debug) {
+	template <typename Log>
+	[[gnu::always_inline]] inline void finalize(Log& debug) {
+		if constexpr (event_sink<Log>) {
+			debug.record({.x = static_cast<std::int16_t>(x),
+			              .y = static_cast<std::int16_t>(y),
+			              .kind = trace_event::input,
+			              .dst = write_port,
+			              .flag = idx != inputs.size(),
+			              .r = write_word});
+		}
 		debug << "I" << x << ": ";
 		if (write_port == port::nil) {
 			// writing this turn
@@ -60,7 +71,7 @@ struct input_node final : node {
 	}
 	std::unique_ptr<input_node> clone() const {
 		auto ret = std::make_unique<input_node>(x, y);
-		ret->reset(inputs);
+		ret->reset({});
 		return ret;
 	}
 	std::string state() const {
@@ -68,7 +79,27 @@ struct input_node final : node {
 		              "/", inputs.size(), ") }");
 	}
 
-	word_vec inputs;
+	/// Everything that changes while running a test
+	struct saved_state {
+		std::size_t idx;
+		optional_word write_word;
+		port write_port;
+		activity s;
+
+		bool operator==(const saved_state&) const = default;
+	};
+	saved_state save() const noexcept {
+		return {idx, write_word, write_port, s};
+	}
+	bool matches(const saved_state& st) const noexcept { return save() == st; }
+	void restore(const saved_state& st) noexcept {
+		idx = st.idx;
+		write_word = st.write_word;
+		write_port = st.write_port;
+		s = st.s;
+	}
+
+	word_view inputs;
 
  private:
 	std::size_t idx{};
@@ -79,14 +110,29 @@ struct output_node : node {
 	using node::node;
 	/// Always not null if the node is simulated
 	node* linked{};
+
+ protected:
+	/// Attempt to read a value from the linked node
+	[[gnu::always_inline]] inline optional_word read_linked() {
+#if TIS_ENABLE_PROFILE
+		auto r = linked->emit(port::down);
+		if (r != word_empty) {
+			++static_cast<regular_node*>(linked)->profile.words_out[port::down];
+		}
+		return r;
+#else
+		return linked->emit(port::down);
+#endif
+	}
 };
 
 struct num_output final : output_node {
 	num_output(int x, int y)
 	    : output_node(x, y, type_t::out) {}
 
-	void reset(word_vec outputs_expected_) {
-		outputs_expected = std::move(outputs_expected_);
+	/// outputs_expected_ must outlive the test
+	void reset(word_view outputs_expected_) {
+		outputs_expected = outputs_expected_;
 		outputs_received.clear();
 		wrong = false;
 		complete = outputs_expected.empty();
@@ -94,15 +140,23 @@ struct num_output final : output_node {
 
 	/// Attempt to read from neighbor every step
 	/// @returns is_active
-	[[gnu::always_inline]] inline bool step(logger& debug) {
+	template <typename Log>
+	[[gnu::always_inline]] inline bool step(Log& debug) {
 		if (complete) {
 			return false;
 		}
-		if (auto r = linked->emit(port::down); r != word_empty) {
+		if (auto r = read_linked(); r != word_empty) {
 			debug << "O" << x << ": read\n";
 			auto i = outputs_received.size();
 			outputs_received.push_back(r);
 			complete = (outputs_expected.size() == outputs_received.size());
+			if constexpr (event_sink<Log>) {
+				debug.record({.x = static_cast<std::int16_t>(x),
+				              .y = static_cast<std::int16_t>(y),
+				              .kind = trace_event::output,
+				              .flag = r != outputs_expected[i],
+				              .r = r});
+			}
 			if (r != outputs_expected[i]) {
 				wrong = true;
 				debug << "incorrect value written\n";
@@ -117,11 +171,11 @@ struct num_output final : output_node {
 	[[gnu::always_inline]] inline bool valid() const {
 		return complete and not wrong;
 	}
-	/// Return a new node initialized in the same way as *this.
-	/// (Not a copy constructor; new node is as if reset() and has no neighbors)
+	/// Return a new node at the same position.
+	/// (Not a copy constructor; new node has no test and no neighbors)
 	std::unique_ptr<num_output> clone() const {
 		auto ret = std::make_unique<num_output>(x, y);
-		ret->reset(outputs_expected);
+		ret->reset({});
 		return ret;
 	}
 	std::string state() const {
@@ -132,7 +186,27 @@ struct num_output final : output_node {
 		return std::move(ret).str();
 	}
 
-	word_vec outputs_expected;
+	/// Everything that changes while running a test
+	struct saved_state {
+		word_vec outputs_received;
+		bool wrong;
+		bool complete;
+
+		bool operator==(const saved_state&) const = default;
+	};
+	saved_state save() const { return {outputs_received, wrong, complete}; }
+	/// Compared in place, without copying the values
+	bool matches(const saved_state& st) const noexcept {
+		return outputs_received == st.outputs_received and wrong == st.wrong
+		       and complete == st.complete;
+	}
+	void restore(const saved_state& st) {
+		outputs_received = st.outputs_received;
+		wrong = st.wrong;
+		complete = st.complete;
+	}
+
+	word_view outputs_expected;
 	word_vec outputs_received;
 
  private:
@@ -144,22 +218,24 @@ struct image_output final : output_node {
 	image_output(int x, int y)
 	    : output_node(x, y, type_t::image) {}
 
-	void reset(image_t image_expected_) {
-		image_expected = std::move(image_expected_);
-		width = image_expected.width();
-		height = image_expected.height();
+	/// image_expected_ must outlive the test
+	void reset(const image_t& image_expected_) {
+		image_expected = &image_expected_;
+		width = image_expected->width();
+		height = image_expected->height();
 		image_received.reshape(width, height);
 		image_received.fill(tis_pixel::C_black);
 		wrong_pixels = std::ranges::count_if(
-		    image_expected, [](auto pix) { return pix != tis_pixel::C_black; });
+		    *image_expected, [](auto pix) { return pix != tis_pixel::C_black; });
 		c_x = word_empty;
 		c_y = word_empty;
 	}
 
 	/// Attempt to read from neighbor every step
 	/// @returns is_active
-	[[gnu::always_inline]] inline bool step(logger&) {
-		if (auto r = linked->emit(port::down); r != word_empty) {
+	template <typename Log>
+	[[gnu::always_inline]] inline bool step(Log&) {
+		if (auto r = read_linked(); r != word_empty) {
 			if (r < 0) {
 				c_x = word_empty;
 				c_y = word_empty;
@@ -175,19 +251,43 @@ struct image_output final : output_node {
 		return bool(wrong_pixels);
 	}
 	[[gnu::always_inline]] inline bool valid() const { return not wrong_pixels; }
-	/// Return a new node initialized in the same way as *this.
-	/// (Not a copy constructor; new node is as if reset() and has no neighbors)u
+	/// Return a new node at the same position.
+	/// (Not a copy constructor; new node has no test and no neighbors)
 	std::unique_ptr<image_output> clone() const {
-		auto ret = std::make_unique<image_output>(x, y);
-		ret->reset(image_expected);
-		return ret;
+		return std::make_unique<image_output>(x, y);
 	}
 	std::string state() const {
 		return concat("O", x, " IMAGE { wrong: ", wrong_pixels, "\n",
 		              image_received.write_text(), "}");
 	}
 
-	image_t image_expected;
+	/// Everything that changes while running a test
+	struct saved_state {
+		image_t image_received;
+		std::size_t wrong_pixels;
+		optional_word c_x;
+		optional_word c_y;
+
+		bool operator==(const saved_state&) const = default;
+	};
+	saved_state save() const {
+		return {image_received, wrong_pixels, c_x, c_y};
+	}
+	/// Compared in place, without copying the image
+	bool matches(const saved_state& st) const noexcept {
+		return image_received == st.image_received
+		       and wrong_pixels == st.wrong_pixels and c_x == st.c_x
+		       and c_y == st.c_y;
+	}
+	void restore(const saved_state& st) {
+		image_received = st.image_received;
+		wrong_pixels = st.wrong_pixels;
+		c_x = st.c_x;
+		c_y = st.c_y;
+	}
+
+	/// not owned, null until reset
+	const image_t* image_expected{};
 	image_t image_received;
 	std::ptrdiff_t width{};
 	std::ptrdiff_t height{};
@@ -196,7 +296,7 @@ struct image_output final : output_node {
 	void poke(tis_pixel pix_new) {
 		if (c_x < width and c_y < height) {
 			auto& pix_rec = image_received[c_x, c_y];
-			auto& pix_exp = image_expected[c_x, c_y];
+			auto& pix_exp = (*image_expected)[c_x, c_y];
 			if (pix_rec == pix_exp) {
 				wrong_pixels++;
 			}
@@ -207,7 +307,7 @@ struct image_output final : output_node {
 		}
 	}
 
-	std::size_t wrong_pixels;
+	std::size_t wrong_pixels{};
 	optional_word c_x = word_empty;
 	optional_word c_y = word_empty;
 };
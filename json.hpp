@@ -0,0 +1,144 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include "parser.hpp"
+#include "utils.hpp"
+
+#include <concepts>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/// Append s to out as a JSON string literal
+inline void append_json_string(std::string& out, std::string_view s) {
+	constexpr std::string_view hex = "0123456789abcdef";
+	out += '"';
+	for (char c : s) {
+		switch (c) {
+		case '"':
+			out += "\\\"";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		case '\t':
+			out += "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				out += "\\u00";
+				out += hex[static_cast<unsigned char>(c) >> 4];
+				out += hex[static_cast<unsigned char>(c) & 0xF];
+			} else {
+				out += c;
+			}
+		}
+	}
+	out += '"';
+}
+
+/// One flat JSON object, written as a single line when destroyed
+class json_record {
+ public:
+	json_record(std::ostream& os, std::string_view type,
+	            std::string_view solution)
+	    : os(os) {
+		line = R"({"type":)";
+		append_json_string(line, type);
+		add("solution", solution);
+	}
+	json_record(const json_record&) = delete;
+	json_record& operator=(const json_record&) = delete;
+	~json_record() {
+		line += "}\n";
+		os << line;
+	}
+
+	json_record& add(std::string_view key, std::string_view value) {
+		append_key(key);
+		append_json_string(line, value);
+		return *this;
+	}
+	json_record& add(std::string_view key, const char* value) {
+		return add(key, std::string_view(value));
+	}
+	json_record& add(std::string_view key, bool value) {
+		append_key(key);
+		line += value ? "true" : "false";
+		return *this;
+	}
+	template <std::integral T>
+	json_record& add(std::string_view key, T value) {
+		append_key(key);
+		append(line, value);
+		return *this;
+	}
+
+ private:
+	void append_key(std::string_view key) {
+		line += ',';
+		append_json_string(line, key);
+		line += ':';
+	}
+
+	std::ostream& os;
+	std::string line;
+};
+
+/// Writes results as JSON Lines. Records are not flushed individually, so the
+/// stream should be buffered. Not thread safe, the runner writes the random
+/// test records under its stats lock.
+class json_writer {
+ public:
+	json_writer(std::ostream& os, bool tests)
+	    : tests(tests)
+	    , os(os) {}
+
+	/// a record of the given type, tagged with the current solution
+	json_record record(std::string_view type) {
+		return json_record(os, type, solution);
+	}
+
+	/// the score fields shared by the solution records
+	static void add_score(json_record& r, const score& sc) {
+		r.add("score", to_string(sc, false))
+		    .add("cycles", sc.cycles)
+		    .add("nodes", sc.nodes)
+		    .add("instructions", sc.instructions)
+		    .add("validated", sc.validated)
+		    .add("achievement", sc.achievement)
+		    .add("cheat", sc.cheat)
+		    .add("hardcoded", sc.hardcoded);
+	}
+
+	/// also write a record for each fixed test and each random seed
+	bool tests;
+	/// path of the solution being run
+	std::string solution;
+
+ private:
+	std::ostream& os;
+};
+
+#endif // JSON_HPP
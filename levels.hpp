@@ -26,6 +26,7 @@
 #include "logger.hpp"
 #include "node.hpp"
 #include "parser.hpp"
+#include "spec_cache.hpp"
 #include "tis_random.hpp"
 #include "utils.hpp"
 
@@ -40,6 +41,7 @@
 #include <vector>
 
 #if TIS_ENABLE_LUA
+#	include <kblib/io.h>
 #	include <sol/sol.hpp>
 #endif
 
@@ -50,7 +52,15 @@ struct level {
 
 	virtual std::optional<single_test> random_test(std::uint32_t seed) = 0;
 
-	std::array<single_test, 3> static_suite() {
+	/// The three fixed tests, from random_test(base_seed * 100 + {0, 1, 2})
+	virtual const std::array<single_test, 3>& static_suite() = 0;
+
+	virtual bool has_achievement(const field& f, const score& sc) const = 0;
+
+	virtual ~level() = default;
+
+ protected:
+	std::array<single_test, 3> make_static_suite() {
 		// static tests never fail to generate
 		return {
 		    *random_test(base_seed * 100),
@@ -59,11 +69,7 @@ struct level {
 		};
 	}
 
-	virtual bool has_achievement(const field& f, const score& sc) const = 0;
-
-	virtual ~level() = default;
-
- protected: // prevents most slicing
+	// prevents most slicing
 	level() = default;
 	level(const level&) = default;
 	level(level&&) = default;
@@ -107,6 +113,9 @@ struct builtin_level final : level {
 
 	std::optional<single_test> random_test(std::uint32_t seed) override;
 
+	/// Embedded at build time by gen_static_suites, in static_suites.cpp
+	const std::array<single_test, 3>& static_suite() override;
+
 	bool has_achievement(const field& solve, const score& sc) const override {
 		auto log = log_debug();
 		log << "check_achievement " << builtin_layouts[level_id].name << ": ";
@@ -178,7 +187,17 @@ struct custom_level final : level {
 	/// sol::state is not thread-safe
 	std::mutex lua_mutex;
 
-	custom_level(const std::string& spec_path) {
+#	ifdef LUAJIT_VERSION
+	static constexpr std::string_view lua_version = LUAJIT_VERSION;
+#	else
+	static constexpr std::string_view lua_version = LUA_RELEASE;
+#	endif
+
+	/// If cache_dir is not empty, the spec is compiled to bytecode and cached
+	/// there with its layout, keyed by the hash of its source, and later
+	/// loaded from the cache instead of evaluated again
+	custom_level(const std::string& spec_path,
+	             const std::filesystem::path& cache_dir = {}) {
 		auto spec_filename = std::filesystem::path(spec_path)
 		                         .filename()
 		                         .replace_extension()
@@ -203,73 +222,11 @@ struct custom_level final : level {
 		lua["STREAM_INPUT"] = node::in;
 		lua["STREAM_OUTPUT"] = node::out;
 		lua["STREAM_IMAGE"] = node::image;
-		lua.script_file(spec_path);
-
-		std::size_t width = 4;
-		if (auto l = lua.get<sol::optional<sol::function>>("get_layout_ext")) {
-			log_info("Extended layout spec detected");
-			sol::table layout = (*l)();
-			auto height = layout.size();
-			log_info("Extended layout height: ", height);
-			if (height == 0) {
-				throw std::invalid_argument(
-				    "get_layout_ext(): layout has zero height");
-			}
-			spec.nodes.resize(height);
-			width = layout.get<sol::table>(1).size();
-			log_info("Extended layout width: ", width);
-			if (width == 0) {
-				throw std::invalid_argument(
-				    "get_layout_ext(): layout has zero width");
-			}
-			spec.inputs.resize(width, node::null);
-			spec.outputs.resize(width, node::null);
-			for (auto c : range(height)) {
-				spec.nodes[c].resize(width);
-				if (layout.get<sol::table>(c + 1).size() != width) {
-					throw std::invalid_argument(
-					    concat("get_layout_ext(): non-rectangular layout specified, "
-					           "line 1 has width ",
-					           width, " while line ", c + 1, " has width ",
-					           layout.get<sol::table>(c).size()));
-				}
-				for (auto r : range(width)) {
-					spec.nodes[c][r] = layout[c + 1][r + 1];
-				}
-			}
+		if (cache_dir.empty()) {
+			lua.script_file(spec_path);
+			load_layout();
 		} else {
-			// unstructured vector, we can only support the default game 4x3 layout
-			sol::table layout = lua["get_layout"]();
-			if (layout.size() != 12) {
-				throw std::invalid_argument{concat(
-				    "get_layout(): Given ", layout.size(), " nodes instead of 12")};
-			}
-			spec.nodes.resize(3, std::vector<node::type_t>(4));
-			spec.inputs.resize(4, node::null);
-			spec.outputs.resize(4, node::null);
-			for (size_t i = 0; i < 12; i++) {
-				spec.nodes[i / 4][i % 4] = layout[i + 1];
-			}
-		}
-		// {{STREAM_$TYPE, "$NAME1", <number in [0-3]>, $list1},
-		//  {STREAM_$TYPE, "$NAME2", <number in [0-3]>, $list2}, ...}
-
-		// name and values unused for layout purposes
-		sol::table streams = lua["get_streams"]();
-		for (const auto& [_, stream] : streams) {
-			sol::table io = stream.as<sol::table>();
-			node::type_t type = io[1];
-			uint id = io[3];
-			if (id >= width) {
-				throw std::runtime_error(
-				    concat("get_streams(): io node (type=", to_string(type),
-				           ") position ", id, " out of range (width=", width, ")"));
-			}
-			if (type == node::in) {
-				spec.inputs[id] = node::in;
-			} else {
-				spec.outputs[id] = type;
-			}
+			load_cached(spec_path, cache_dir);
 		}
 
 		// stop custom level authors from messing with the game
@@ -344,9 +301,123 @@ struct custom_level final : level {
 		return ret;
 	}
 
+	const std::array<single_test, 3>& static_suite() override {
+		if (not fixed_tests) {
+			fixed_tests = make_static_suite();
+		}
+		return *fixed_tests;
+	}
+
 	bool has_achievement(const field&, const score&) const override {
 		return false;
 	}
+
+ private:
+	/// -L gives one level for all the solutions
+	std::optional<std::array<single_test, 3>> fixed_tests;
+
+	/// Fill spec from the layout functions of the loaded spec
+	void load_layout() {
+		std::size_t width = 4;
+
+		if (auto l = lua.get<sol::optional<sol::function>>("get_layout_ext")) {
+			log_info("Extended layout spec detected");
+			sol::table layout = (*l)();
+			auto height = layout.size();
+			log_info("Extended layout height: ", height);
+			if (height == 0) {
+				throw std::invalid_argument(
+				    "get_layout_ext(): layout has zero height");
+			}
+			spec.nodes.resize(height);
+			width = layout.get<sol::table>(1).size();
+			log_info("Extended layout width: ", width);
+			if (width == 0) {
+				throw std::invalid_argument(
+				    "get_layout_ext(): layout has zero width");
+			}
+			spec.inputs.resize(width, node::null);
+			spec.outputs.resize(width, node::null);
+			for (auto c : range(height)) {
+				spec.nodes[c].resize(width);
+				if (layout.get<sol::table>(c + 1).size() != width) {
+					throw std::invalid_argument(
+					    concat("get_layout_ext(): non-rectangular layout specified, "
+					           "line 1 has width ",
+					           width, " while line ", c + 1, " has width ",
+					           layout.get<sol::table>(c).size()));
+				}
+				for (auto r : range(width)) {
+					spec.nodes[c][r] = layout[c + 1][r + 1];
+				}
+			}
+		} else {
+			// unstructured vector, we can only support the default game 4x3 layout
+			sol::table layout = lua["get_layout"]();
+			if (layout.size() != 12) {
+				throw std::invalid_argument{concat(
+				    "get_layout(): Given ", layout.size(), " nodes instead of 12")};
+			}
+			spec.nodes.resize(3, std::vector<node::type_t>(4));
+			spec.inputs.resize(4, node::null);
+			spec.outputs.resize(4, node::null);
+			for (size_t i = 0; i < 12; i++) {
+				spec.nodes[i / 4][i % 4] = layout[i + 1];
+			}
+		}
+		// {{STREAM_$TYPE, "$NAME1", <number in [0-3]>, $list1},
+		//  {STREAM_$TYPE, "$NAME2", <number in [0-3]>, $list2}, ...}
+
+		// name and values unused for layout purposes
+		sol::table streams = lua["get_streams"]();
+		for (const auto& [_, stream] : streams) {
+			sol::table io = stream.as<sol::table>();
+			node::type_t type = io[1];
+			uint id = io[3];
+			if (id >= width) {
+				throw std::runtime_error(
+				    concat("get_streams(): io node (type=", to_string(type),
+				           ") position ", id, " out of range (width=", width, ")"));
+			}
+			if (type == node::in) {
+				spec.inputs[id] = node::in;
+			} else {
+				spec.outputs[id] = type;
+			}
+		}
+
+	}
+
+	void load_cached(const std::string& spec_path,
+	                 const std::filesystem::path& cache_dir) {
+		auto source = kblib::try_get_file_contents(
+		    spec_path, std::ios::in | std::ios::binary);
+		auto path = spec_cache_path(cache_dir, source, lua_version);
+		auto chunkname = concat('@', spec_path);
+		if (auto entry = read_spec_cache(path, lua_version)) {
+			log_info("Loading custom spec from cache ", path.string());
+			lua.script(entry->bytecode, chunkname);
+			spec = std::move(entry->layout);
+			return;
+		}
+
+		sol::load_result chunk = lua.load(source, chunkname);
+		if (not chunk.valid()) {
+			sol::error e = chunk;
+			throw e;
+		}
+		sol::protected_function main_chunk = chunk;
+		sol::function dump = lua["string"]["dump"];
+		std::string bytecode = dump(main_chunk);
+		if (auto r = main_chunk(); not r.valid()) {
+			sol::error e = r;
+			throw e;
+		}
+		load_layout();
+		std::error_code ec;
+		std::filesystem::create_directories(cache_dir, ec);
+		write_spec_cache(path, {spec, std::move(bytecode)}, lua_version);
+	}
 };
 #endif
 
@@ -17,13 +17,76 @@
  * ****************************************************************************/
 #include "logger.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <mutex>
+#include <string>
+#include <vector>
 
 static log_level current = log_level::notice;
 static std::ostream* output = &std::clog;
 std::recursive_mutex log_m;
 
+namespace {
+
+/// Single producer, single consumer ring of messages. The owning thread
+/// pushes, the async_log writer drains.
+struct thread_buffer {
+	static constexpr std::size_t capacity = 4096;
+
+	unsigned id{};
+	/// prepended to every message, only touched by the producer
+	std::string label;
+	std::array<std::string, capacity> slots;
+	alignas(64) std::atomic<std::size_t> head{};
+	alignas(64) std::atomic<std::size_t> tail{};
+
+	void push(std::string_view str) {
+		auto t = tail.load(std::memory_order_relaxed);
+		// the writer is behind, wait for it rather than dropping messages
+		while (t - head.load(std::memory_order_acquire) == capacity) {
+			std::this_thread::yield();
+		}
+		auto& slot = slots[t % capacity];
+		slot.assign(label);
+		slot.append(str);
+		tail.store(t + 1, std::memory_order_release);
+	}
+
+	/// @returns true if any message was written
+	bool drain(std::ostream& os) {
+		auto h = head.load(std::memory_order_relaxed);
+		auto t = tail.load(std::memory_order_acquire);
+		for (auto i = h; i != t; ++i) {
+			os << slots[i % capacity] << '\n';
+		}
+		head.store(t, std::memory_order_release);
+		return h != t;
+	}
+};
+
+std::atomic<bool> async_active;
+/// protects buffers, only contended when threads attach
+std::mutex buffers_m;
+std::vector<std::unique_ptr<thread_buffer>> buffers;
+thread_local thread_buffer* this_buffer;
+
+bool drain_all() {
+	std::scoped_lock l(buffers_m, log_m);
+	bool any{};
+	for (auto& b : buffers) {
+		any |= b->drain(*output);
+	}
+	if (any) {
+		output->flush();
+	}
+	return any;
+}
+
+} // namespace
+
 auto set_log_level(log_level new_level) -> void { current = new_level; }
 
 auto get_log_level() -> log_level { return current; }
@@ -33,6 +96,10 @@ namespace detail {
 static bool flush;
 
 auto log(std::string_view str) -> void {
+	if (this_buffer) {
+		this_buffer->push(str);
+		return;
+	}
 	std::unique_lock l(log_m);
 	(*output) << str << '\n';
 	if (flush) {
@@ -43,6 +110,10 @@ auto log(std::string_view str) -> void {
 } // namespace detail
 
 auto log_flush() -> void {
+	if (this_buffer) {
+		// the writer flushes after each batch
+		return;
+	}
 	std::unique_lock l(log_m);
 	output->flush();
 }
@@ -53,3 +124,56 @@ logger::logger(std::string_view prefix)
     : formatter_{std::make_unique<std::ostringstream>()} {
 	(*formatter_) << prefix;
 }
+
+async_log::async_log()
+    : writer([](std::stop_token stop) {
+	    using namespace std::chrono_literals;
+	    while (not stop.stop_requested()) {
+		    if (not drain_all()) {
+			    std::this_thread::sleep_for(1ms);
+		    }
+	    }
+    }) {
+	async_active = true;
+}
+
+async_log::~async_log() {
+	async_active = false;
+	writer.request_stop();
+	writer.join();
+	drain_all();
+	std::unique_lock l(buffers_m);
+	buffers.clear();
+}
+
+log_thread_scope::log_thread_scope(unsigned id) {
+	if (not async_active) {
+		return;
+	}
+	auto b = std::make_unique<thread_buffer>();
+	b->id = id;
+	b->label = concat("[T", id, "] ");
+	std::unique_lock l(buffers_m);
+	this_buffer = buffers.emplace_back(std::move(b)).get();
+}
+
+// the buffer stays registered until the async_log drains it for the last time
+log_thread_scope::~log_thread_scope() { this_buffer = nullptr; }
+
+log_redirect::log_redirect(std::ostream& os, log_level level)
+    : old_output(output)
+    , old_level(current) {
+	output = &os;
+	current = level;
+}
+
+log_redirect::~log_redirect() {
+	output = old_output;
+	current = old_level;
+}
+
+auto set_log_seed(std::uint32_t seed) -> void {
+	if (this_buffer) {
+		this_buffer->label = concat("[T", this_buffer->id, " seed ", seed, "] ");
+	}
+}
@@ -21,9 +21,12 @@
 #include "utils.hpp"
 
 #include <concepts>
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <sstream>
 #include <string_view>
+#include <thread>
 #include <utility>
 
 namespace detail {
@@ -46,6 +49,50 @@ auto get_log_level() -> log_level;
 auto log_flush() -> void;
 auto set_log_flush(bool do_flush) -> void;
 
+/// While alive, messages from threads inside a log_thread_scope go to
+/// lock-free per-thread buffers that a dedicated thread drains into the log,
+/// instead of taking the global log mutex. Message order is kept within each
+/// thread, and every line is labelled with the thread and its current seed.
+class async_log {
+ public:
+	async_log();
+	~async_log();
+	async_log(const async_log&) = delete;
+	async_log& operator=(const async_log&) = delete;
+
+ private:
+	std::jthread writer;
+};
+
+/// Attach the calling thread to the active async_log, if any, for the
+/// lifetime of this object
+class log_thread_scope {
+ public:
+	explicit log_thread_scope(unsigned id);
+	~log_thread_scope();
+	log_thread_scope(const log_thread_scope&) = delete;
+	log_thread_scope& operator=(const log_thread_scope&) = delete;
+};
+
+/// While alive, the log is written to os at the given level instead, for
+/// checks that need the debug text to be formatted but not printed. Not
+/// thread safe, nothing else may log meanwhile.
+class log_redirect {
+ public:
+	log_redirect(std::ostream& os, log_level level);
+	~log_redirect();
+	log_redirect(const log_redirect&) = delete;
+	log_redirect& operator=(const log_redirect&) = delete;
+
+ private:
+	std::ostream* old_output;
+	log_level old_level;
+};
+
+/// Set the seed shown in the labels of the calling thread's messages, only
+/// used inside a log_thread_scope
+auto set_log_seed(std::uint32_t seed) -> void;
+
 template <typename... Strings>
 auto log_debug([[maybe_unused]] Strings&&... strings) -> void {
 #if TIS_ENABLE_DEBUG
@@ -155,6 +202,15 @@ class logger {
 	std::unique_ptr<std::ostringstream> formatter_;
 };
 
+/// Logging policy for the simulation kernels that compiles to nothing, used
+/// when the log level is too low for their output
+struct null_logger {
+	constexpr auto log_r(auto&&) -> void {}
+	constexpr auto log(auto&&...) -> void {}
+	constexpr auto operator<<(const auto&) -> null_logger& { return *this; }
+	constexpr bool good() const { return false; }
+};
+
 inline auto log_debug() {
 #if TIS_ENABLE_DEBUG
 	if (get_log_level() >= log_level::debug) {
@@ -19,11 +19,19 @@
 #include "levels.hpp"
 #include "logger.hpp"
 #include "node.hpp"
+#include "fuzz.hpp"
+#include "inspect.hpp"
+#include "json.hpp"
 #include "parser.hpp"
 #include "runner.hpp"
+#include "seed_catalogue.hpp"
+#include "tar.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
+#include "workload.hpp"
 
 #include <csignal>
+#include <fstream>
 #include <iostream>
 #include <kblib/hash.h>
 #include <kblib/io.h>
@@ -212,17 +220,309 @@ void validation_summary(const score& sc, int fixed, int quiet,
 	}
 }
 
+void print_score(const score& sc, uint count, uint valid_count, bool stats,
+                 int quiet, double cheat_rate) {
+	log_flush();
+	if (not quiet) {
+		std::cout << "score: ";
+	}
+	std::cout << to_string(sc);
+	if (count > 0 and stats) {
+		const auto rate = 100. * valid_count / count;
+		std::cout << " PR: ";
+		if (valid_count == count) {
+			std::cout << print_escape(bright_blue, bold);
+		} else if (rate >= 100 * cheat_rate) {
+			std::cout << print_escape(yellow);
+		} else {
+			std::cout << print_escape(bright_red);
+		}
+		std::cout << rate << '%' << print_escape(none) << " (" << valid_count
+		          << '/' << count << ")";
+	}
+	std::cout << std::endl;
+}
+
+/// The level of a save, from its filename, or else from its folder, as in
+/// the leaderboard archives (TIS-100*/<segment>/<segment>.<score>.txt)
+std::optional<uint> deduce_level_id(const std::filesystem::path& path) {
+	if (auto id = guess_level_id(path.filename().string())) {
+		return id;
+	}
+	return guess_level_id(path.parent_path().filename().string());
+}
+
+/// The score in the name of a leaderboard save, like 00150.83-8-8-a.txt, in
+/// the format of to_string(score)
+std::optional<std::string> score_from_name(std::string_view filename) {
+	auto dot = filename.find('.');
+	if (dot == std::string_view::npos or not filename.ends_with(".txt")) {
+		return std::nullopt;
+	}
+	auto parts = kblib::split_dsv(
+	    filename.substr(dot + 1, filename.size() - dot - 1 - 4), '-');
+	if (parts.size() < 3 or parts.size() > 4) {
+		return std::nullopt;
+	}
+	std::string ret;
+	for (auto [part, i] : kblib::enumerate(parts)) {
+		auto digits = part.find_first_not_of("0123456789");
+		if (part.empty() or (i < 3 and digits != std::string::npos)
+		    or (i == 3 and part.find_first_not_of("ach") != std::string::npos)) {
+			return std::nullopt;
+		}
+		append(ret, i ? "/" : "", part);
+	}
+	return ret;
+}
+
 enum exit_code : int { SUCCESS = 0, FAILURE = 1, EXCEPTION = 2 };
 
+int decode_trace_main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("Print a binary trace written with --trace-file in the "
+	                   "format of the debug log.");
+	TCLAP::UnlabeledValueArg<std::string> path(
+	    "Trace", "Path to the trace file", true, "", "path", cmd);
+	cmd.parse(argc, argv);
+
+	decode_trace(path.getValue(), std::cout);
+	return exit_code::SUCCESS;
+}
+
+int merge_main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("Merge the result files written by the shards of a run "
+	                   "with --shard into the score of a single run.");
+	TCLAP::UnlabeledMultiArg<std::string> paths(
+	    "Results", "Paths to the shard result files", true, "path", cmd);
+	TCLAP::MultiSwitchArg quiet("q", "quiet",
+	                            "Suppress printing anything but score and "
+	                            "errors. A second flag suppresses errors.",
+	                            cmd);
+	TCLAP::SwitchArg color("c", "color",
+	                       "Print in color. "
+	                       "(Defaults on if STDOUT is a tty.)",
+	                       cmd);
+	cmd.parse(argc, argv);
+	color_stdout = color.isSet() or isatty(STDOUT_FILENO);
+
+	std::vector<shard_result> shards;
+	for (const auto& path : paths.getValue()) {
+		shards.push_back(read_shard_result(path));
+	}
+	uint count{};
+	uint valid_count{};
+	auto sc = merge_shard_results(shards, count, valid_count);
+
+	std::ranges::sort(shards, {}, &shard_result::shard);
+	std::vector<std::uint32_t> failing_seeds;
+	for (const auto& r : shards) {
+		failing_seeds.insert(failing_seeds.end(), r.failing_seeds.begin(),
+		                     r.failing_seeds.end());
+	}
+	if (not failing_seeds.empty() and quiet.getValue() < 2) {
+		std::cout << "failing seeds:";
+		for (auto seed : failing_seeds | std::views::take(max_recorded_failures)) {
+			std::cout << ' ' << seed;
+		}
+		std::cout << '\n';
+	}
+	print_score(sc, count, valid_count, true, quiet.getValue(),
+	            shards.front().cheat_rate);
+	return sc.validated ? exit_code::SUCCESS : exit_code::FAILURE;
+}
+
+int fuzz_main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("Compare every step kernel in this build against the "
+	                   "reference one, cycle by cycle, on random layouts, "
+	                   "programs and inputs. The first divergence is minimized "
+	                   "and printed.");
+	TCLAP::ValueArg<std::uint64_t> seed(
+	    "", "seed", "Seed of the first case. (Default random)", false, 0,
+	    "uint64_t", cmd);
+	TCLAP::ValueArg<human_readable_integer<std::uint64_t>> cases(
+	    "n", "cases", "Number of random cases. (Default 10K)", false, 10'000,
+	    "integer", cmd);
+	TCLAP::ValueArg<human_readable_integer<std::size_t>> cycles(
+	    "", "cycles", "Cycles to simulate for each case. (Default 500)", false,
+	    500, "integer", cmd);
+	cmd.parse(argc, argv);
+
+	auto first_seed = seed.getValue();
+	if (not seed.isSet()) {
+		first_seed = std::random_device{}();
+		log_notice("Fuzzing from seed ", first_seed);
+	}
+	return fuzz_kernels(first_seed, cases.getValue().val, cycles.getValue().val,
+	                    std::cout)
+	           ? exit_code::SUCCESS
+	           : exit_code::FAILURE;
+}
+
+int generate_main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("Write a synthetic custom level and a solution that "
+	                   "validates it, for benchmarking. The level is written "
+	                   "to <prefix>.lua and the solution to <prefix>.txt.");
+	TCLAP::UnlabeledValueArg<std::string> prefix(
+	    "Prefix", "Path of the output files, without extension", true, "",
+	    "path", cmd);
+	TCLAP::ValueArg<std::size_t> width("", "width", "Columns. (Default 8)",
+	                                   false, 8, "integer", cmd);
+	TCLAP::ValueArg<std::size_t> height("", "height", "Rows. (Default 8)",
+	                                    false, 8, "integer", cmd);
+	TCLAP::ValueArg<double> traffic(
+	    "", "traffic",
+	    "Fraction of the columns with an input and an output, at least one. "
+	    "(Default 0.5)",
+	    false, .5, "fraction", cmd);
+	TCLAP::ValueArg<double> t30(
+	    "", "t30", "Fraction of the other nodes that are T30. (Default 0.1)",
+	    false, .1, "fraction", cmd);
+	TCLAP::ValueArg<double> stalled(
+	    "", "stalled",
+	    "Fraction of the other T21 nodes that block forever, the rest run "
+	    "ADD and SUB. (Default 0.2)",
+	    false, .2, "fraction", cmd);
+	TCLAP::ValueArg<double> alu(
+	    "", "alu",
+	    "Fraction of the stream nodes that do arithmetic on each value "
+	    "instead of passing it with a single MOV. (Default 0.5)",
+	    false, .5, "fraction", cmd);
+	TCLAP::ValueArg<std::size_t> length(
+	    "", "length", "Values in each stream. (Default 39)", false, 39,
+	    "integer", cmd);
+	TCLAP::ValueArg<std::uint64_t> seed(
+	    "", "seed", "Seed of the layout and code. (Default 0)", false, 0,
+	    "uint64_t", cmd);
+	cmd.parse(argc, argv);
+
+	auto w = make_workload({.width = width.getValue(),
+	                        .height = height.getValue(),
+	                        .traffic = traffic.getValue(),
+	                        .t30 = t30.getValue(),
+	                        .stalled = stalled.getValue(),
+	                        .alu = alu.getValue(),
+	                        .length = length.getValue(),
+	                        .seed = seed.getValue()});
+	for (auto [ext, text] : {std::pair{".lua"sv, std::string_view(w.spec)},
+	                         std::pair{".txt"sv, std::string_view(w.solution)}}) {
+		auto path = concat(prefix.getValue(), ext);
+		std::ofstream out(path, std::ios::trunc);
+		if (not (out << text)) {
+			throw std::runtime_error{concat("Could not write ", path)};
+		}
+	}
+	log_notice("Run with: TIS-100-CXX -L ", prefix.getValue(), ".lua ",
+	           prefix.getValue(), ".txt");
+	return exit_code::SUCCESS;
+}
+
+int catalogue_main(int argc, char** argv) {
+	TCLAP::CmdLine cmd("Build a seed catalogue for --seed-catalogue from a "
+	                   "corpus of known cheating solutions of builtin levels: "
+	                   "for each level, the seeds that the most solutions "
+	                   "fail.");
+	TCLAP::UnlabeledMultiArg<std::string> solutions(
+	    "Solution",
+	    "Paths to the cheating solutions, the level is deduced from the "
+	    "filename or its folder",
+	    true, "path", cmd);
+	TCLAP::ValueArg<std::string> output(
+	    "o", "output", "File to write the catalogue to", true, "", "path", cmd);
+	TCLAP::MultiArg<std::string> seed_exprs(
+	    "", "seeds", "The seeds to try. (Default 0..99999)", false,
+	    "[range-expr...]", cmd);
+	TCLAP::ValueArg<human_readable_integer<std::size_t>> size(
+	    "n", "size", "Max seeds per level. (Default 100)", false, 100,
+	    "integer", cmd);
+	TCLAP::ValueArg<human_readable_integer<size_t>> cycles_limit(
+	    "", "limit",
+	    "Number of cycles to run test for before timeout. (Default 100500)",
+	    false, 100'500, "integer", cmd);
+	TCLAP::ValueArg<double> limit_multiplier(
+	    "k", "limit-multiplier",
+	    "Value to multiply cycle score by to determine random test timeout "
+	    "limit. (Default 5)",
+	    false, 5, "number", cmd);
+	TCLAP::ValueArg<unsigned> threads(
+	    "j", "threads", "Number of threads to use. (Default automatic)", false,
+	    0, "integer", cmd);
+	cmd.parse(argc, argv);
+	signal(SIGTERM, sigterm_handler);
+	signal(SIGINT, sigterm_handler);
+
+	auto seed_ranges = seed_exprs.isSet() ? parse_ranges(seed_exprs.getValue())
+	                                      : std::vector<range_t>{{0, 100'000}};
+	auto num_threads = threads.getValue();
+	if (num_threads == 0) {
+		// 0 if it's unknown
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	catalogue_builder builder(seed_ranges, cycles_limit.getValue().val,
+	                          limit_multiplier.getValue(), num_threads);
+	std::size_t counted{};
+	for (const auto& solution : solutions.getValue()) {
+		auto id = deduce_level_id(solution);
+		if (not id) {
+			log_warn("Skipping ", kblib::quoted(solution),
+			         ": impossible to determine the level ID");
+			continue;
+		}
+		auto code = kblib::try_get_file_contents(solution, std::ios::in);
+		std::optional<std::size_t> failures;
+		try {
+			failures = builder.add(*id, code, def_T21_size, def_T30_size);
+		} catch (const std::invalid_argument& e) {
+			log_warn("Skipping ", kblib::quoted(solution), ": ", e.what());
+			continue;
+		}
+		if (not failures) {
+			log_warn("Skipping ", kblib::quoted(solution),
+			         ": it fails the fixed tests");
+		} else if (*failures == 0) {
+			log_warn(kblib::quoted(solution), " passes every seed");
+		} else {
+			log_info(kblib::quoted(solution), " fails ", *failures, " seeds");
+			++counted;
+		}
+		if (stop_requested) {
+			log_warn("Stop requested");
+			return exit_code::FAILURE;
+		}
+	}
+
+	write_seed_catalogue(output.getValue(),
+	                     builder.build(size.getValue().val));
+	log_notice("Catalogue written from ", counted, " cheating solutions");
+	return exit_code::SUCCESS;
+}
+
 int main(int argc, char** argv) try {
 	std::ios_base::sync_with_stdio(false);
 	set_log_flush(not RELEASE);
 
+	if (argc > 1 and argv[1] == "decode-trace"sv) {
+		return decode_trace_main(argc - 1, argv + 1);
+	} else if (argc > 1 and argv[1] == "merge"sv) {
+		return merge_main(argc - 1, argv + 1);
+	} else if (argc > 1 and argv[1] == "fuzz"sv) {
+		return fuzz_main(argc - 1, argv + 1);
+	} else if (argc > 1 and argv[1] == "generate"sv) {
+		return generate_main(argc - 1, argv + 1);
+	} else if (argc > 1 and argv[1] == "catalogue"sv) {
+		return catalogue_main(argc - 1, argv + 1);
+	}
+
 	TCLAP::CmdLine cmd(
-	    "TIS-100 simulator and validator. For options --limit, --total-limit, "
-	    "--random, --seed, --seeds, and --T30_size, integer arguments can be "
-	    "specified with a scale suffix, either K, M, or B (case-insensitive) "
-	    "for thousand, million, or billion respectively.");
+	    "TIS-100 simulator and validator. Run with decode-trace as the first "
+	    "argument to print a trace file, with merge to combine the results "
+	    "of --shard runs, with fuzz to check the step kernels against each "
+	    "other, with generate to write a synthetic level for benchmarks, or "
+	    "with catalogue to build a --seed-catalogue. "
+	    "For options --limit, --total-limit, "
+	    "--random, --seed, --seeds, --hunt, --T30_size, and --T30_memory, "
+	    "integer arguments can be specified with a scale suffix, either K, M, "
+	    "or B (case-insensitive) for thousand, million, or billion "
+	    "respectively.");
 
 	std::vector<std::string> ids_v;
 	for (auto l : builtin_layouts) {
@@ -233,6 +533,11 @@ int main(int argc, char** argv) try {
 	TCLAP::UnlabeledMultiArg<std::string> solutions(
 	    "Solution", "Paths to solution files. ('-' for stdin)", true, "path",
 	    cmd);
+	TCLAP::SwitchArg tar(
+	    "", "tar",
+	    "The paths are uncompressed tar archives, each .txt file in them is "
+	    "validated as a solution and compared with the score in its name",
+	    cmd);
 
 	TCLAP::ValuesConstraint<std::string> ids_c(ids_v);
 	TCLAP::ValueArg<std::string> id_arg("l", "ID", "Level ID (Segment or name).",
@@ -242,6 +547,10 @@ int main(int argc, char** argv) try {
 	    "L", "custom-spec", "Custom Lua Spec file", false, "", "path");
 	TCLAP::EitherOf level_args(cmd);
 	level_args.add(id_arg).add(custom_spec_arg);
+	TCLAP::ValueArg<std::string> spec_cache(
+	    "", "spec-cache",
+	    "Directory to cache custom specs in, compiled with their layout.",
+	    false, "", "path", cmd);
 #else
 	cmd.add(id_arg);
 #endif
@@ -257,9 +566,13 @@ int main(int argc, char** argv) try {
 	    false, kblib::max.of<std::size_t>(), "integer", cmd);
 	TCLAP::ValueArg<unsigned> threads("j", "threads",
 	                                  "Number of threads to use, or 0 for "
-	                                  "automatic. Log level must be info or "
-	                                  "lower.",
+	                                  "automatic.",
 	                                  false, 1, "integer", cmd);
+	TCLAP::ValueArg<unsigned> test_threads(
+	    "", "test-threads",
+	    "Number of threads to split each fixed test between, for large "
+	    "custom layouts, or 0 for automatic. (Default 1)",
+	    false, 1, "integer", cmd);
 
 	TCLAP::ValueArg<bool> fixed("", "fixed", "Run fixed tests. (Default 1)",
 	                            false, true, "[0,1]", cmd);
@@ -273,9 +586,36 @@ int main(int argc, char** argv) try {
 	TCLAP::SwitchArg stats(
 	    "S", "stats", "Run all random tests requested and calculate pass rate",
 	    cmd);
+	TCLAP::SwitchArg cycle_histograms(
+	    "", "histogram",
+	    "Report the distribution of the cycle counts of the random tests, "
+	    "for passes, timeouts, and failures by output node",
+	    cmd);
 	TCLAP::MultiArg<std::string> seed_exprs("", "seeds",
 	                                        "A range of seed values to use",
 	                                        false, "[range-expr...]", cmd);
+	TCLAP::ValueArg<human_readable_integer<std::size_t>> hunt(
+	    "", "hunt",
+	    "Instead of the random tests, search all seeds (or those given with "
+	    "--seeds) for random tests the solution fails, stopping after N "
+	    "failures. Uses every core unless -j is given.",
+	    false, 1, "integer", cmd);
+	TCLAP::ValueArg<std::string> seed_catalogue_arg(
+	    "", "seed-catalogue",
+	    "Without -S, run first the seeds that this catalogue, written by the "
+	    "catalogue subcommand, lists for the level, so that cheats fail "
+	    "sooner. The /c and /h flags stay the same, the test counts don't.",
+	    false, "", "path", cmd);
+	TCLAP::ValueArg<std::string> shard(
+	    "", "shard",
+	    "Run only part I of the random tests split in N parts, for N "
+	    "independent runs, and write the result to --shard-result. Implies -S.",
+	    false, "", "I/N", cmd);
+	TCLAP::ValueArg<std::string> shard_result_file(
+	    "", "shard-result",
+	    "File to write the result of a --shard run to, for the merge "
+	    "subcommand",
+	    false, "", "path", cmd);
 	TCLAP::AnyOf implicit_random(cmd);
 	implicit_random.add(random_arg).add(seed_arg);
 	range_constraint percentage(0.0, 1.0);
@@ -303,6 +643,12 @@ int main(int argc, char** argv) try {
 	    "", "T30_size",
 	    concat("Memory capacity of T30 nodes. (Default ", def_T30_size, ")"),
 	    false, def_T30_size, "integer", cmd);
+	TCLAP::ValueArg<human_readable_integer<std::size_t>> T30_memory_arg(
+	    "", "T30_memory",
+	    concat("Max values stored by all T30 nodes at once, across threads. "
+	           "(Default ",
+	           T30_memory.limit, ")"),
+	    false, T30_memory.limit, "integer", cmd);
 
 	std::vector<std::string> loglevels_allowed{
 	    "none", "err", "error", "warn", "notice", "info", "trace", "debug"};
@@ -325,6 +671,11 @@ int main(int argc, char** argv) try {
 #endif
 	    .add(trace_loglevel)
 	    .add(info_loglevel);
+	TCLAP::SwitchArg trace_delta(
+	    "", "trace-delta",
+	    "At log level trace, print the whole field once per test and then "
+	    "only the nodes that changed in each cycle",
+	    cmd);
 
 	TCLAP::MultiSwitchArg quiet("q", "quiet",
 	                            "Suppress printing anything but score and "
@@ -334,6 +685,13 @@ int main(int argc, char** argv) try {
 	                       "Print in color. "
 	                       "(Defaults on if STDOUT is a tty.)",
 	                       cmd);
+	TCLAP::SwitchArg json_arg(
+	    "", "json",
+	    "Print a JSON object per solution, one per line, instead of text", cmd);
+	TCLAP::SwitchArg json_tests(
+	    "", "json-tests",
+	    "Like --json, also printing an object per fixed test and random seed",
+	    cmd);
 	TCLAP::SwitchArg log_color("C", "log-color",
 	                           "Enable colors in the log. "
 	                           "(Defaults on if STDERR is a tty.)",
@@ -341,6 +699,42 @@ int main(int argc, char** argv) try {
 
 	TCLAP::SwitchArg dry_run(
 	    "", "dry-run", "Parse the command line, but don't run any tests", cmd);
+	TCLAP::SwitchArg perf(
+	    "", "perf",
+	    "Measure host hardware counters (instructions, cycles, branch and "
+	    "cache misses) for each fixed test and each random test thread",
+	    cmd);
+	TCLAP::ValueArg<std::string> trace_file(
+	    "", "trace-file",
+	    "Record every simulated cycle into a compact binary trace, which can "
+	    "be printed with the decode-trace subcommand. Requires a single thread.",
+	    false, "", "path", cmd);
+	TCLAP::ValueArg<unsigned> inspect_test(
+	    "", "inspect",
+	    "Instead of validating, run fixed test N (1-3), or with 0 the random "
+	    "test of --seed, then print the state of the field at the cycles read "
+	    "from stdin. Requires a single solution.",
+	    false, 1, "integer", cmd);
+	TCLAP::ValueArg<std::size_t> snapshot_interval(
+	    "", "snapshot-interval",
+	    "Cycles between the snapshots of the field kept by --inspect. "
+	    "(Default 1000)",
+	    false, 1000, "integer", cmd);
+	TCLAP::ValueArg<std::string> checkpoint(
+	    "", "checkpoint",
+	    "Save the progress of the random tests to this file every minute and "
+	    "when they end or are stopped. Requires a single solution.",
+	    false, "", "path", cmd);
+	TCLAP::SwitchArg resume(
+	    "", "resume",
+	    "Continue the random tests from the --checkpoint file, if it exists",
+	    cmd);
+#if TIS_ENABLE_PROFILE
+	TCLAP::SwitchArg profile(
+	    "", "profile",
+	    "Print per-node utilization heatmaps accumulated over the fixed tests",
+	    cmd);
+#endif
 
 	cmd.parse(argc, argv);
 
@@ -356,6 +750,7 @@ int main(int argc, char** argv) try {
 #endif
 
 	auto cycles_limit = cycles_limit_arg.getValue().val;
+	T30_memory.limit = T30_memory_arg.getValue().val;
 	auto total_cycles_limit = total_cycles_limit_arg.getValue().val;
 
 	set_log_level([&] {
@@ -394,17 +789,72 @@ int main(int argc, char** argv) try {
 		}
 	}());
 
+	trace_deltas = trace_delta.getValue();
+
 	unsigned num_threads = threads.getValue();
-	if (threads.getValue() != 1) {
-		if (get_log_level() > log_level::info) {
-			throw std::invalid_argument(
-			    "log_level cannot be higher than info with -j");
+	if (threads.getValue() == 0) {
+		// 0 if it's unknown
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	log_info("Using ", num_threads, " threads");
+	unsigned num_test_threads = test_threads.getValue();
+	if (num_test_threads == 0) {
+		num_test_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	if (trace_file.isSet() and num_threads != 1) {
+		throw std::invalid_argument{"--trace-file cannot be used with -j"};
+	}
+	// the solutions to validate, with their code if it comes from an archive
+	std::vector<std::pair<std::string, std::optional<std::string>>> inputs;
+	for (const auto& path : solutions.getValue()) {
+		if (not tar.isSet()) {
+			inputs.emplace_back(path, std::nullopt);
+			continue;
 		}
-		if (threads.getValue() == 0) {
-			num_threads = std::thread::hardware_concurrency();
+		std::ifstream file;
+		if (path != "-") {
+			file.open(path, std::ios::binary);
+			if (not file) {
+				throw std::runtime_error{
+				    concat("Could not open ", kblib::quoted(path))};
+			}
+		}
+		auto members = read_tar(path == "-" ? std::cin : file);
+		log_info("Read ", members.size(), " files from ", kblib::quoted(path));
+		for (auto& m : members) {
+			// the saves, not the readme files
+			if (m.path.ends_with(".txt")) {
+				inputs.emplace_back(std::move(m.path), std::move(m.contents));
+			}
 		}
 	}
-	log_info("Using ", num_threads, " threads");
+
+	if (checkpoint.isSet() and inputs.size() > 1) {
+		throw std::invalid_argument{
+		    "--checkpoint cannot be used with multiple solutions"};
+	} else if (resume.isSet() and not checkpoint.isSet()) {
+		throw std::invalid_argument{"--resume requires --checkpoint"};
+	}
+	if (inspect_test.isSet()) {
+		if (inputs.size() > 1 or std::ranges::count(solutions.getValue(), "-")) {
+			throw std::invalid_argument{
+			    "--inspect requires a single solution, not from stdin"};
+		} else if (inspect_test.getValue() > 3) {
+			throw std::invalid_argument{"--inspect takes a fixed test, 1-3"};
+		} else if (inspect_test.getValue() == 0 and not seed_arg.isSet()) {
+			throw std::invalid_argument{"--inspect 0 requires --seed"};
+		}
+	}
+	if (shard.isSet() != shard_result_file.isSet()) {
+		throw std::invalid_argument{
+		    "--shard and --shard-result must be used together"};
+	} else if (shard.isSet() and inputs.size() > 1) {
+		throw std::invalid_argument{
+		    "--shard cannot be used with multiple solutions"};
+	} else if (shard.isSet() and (hunt.isSet() or total_cycles_limit_arg.isSet())) {
+		throw std::invalid_argument{
+		    "--shard cannot be used with --hunt or --total-limit"};
+	}
 
 	std::vector<range_t> seed_ranges;
 
@@ -426,6 +876,28 @@ int main(int argc, char** argv) try {
 		seed_ranges.push_back({seed, seed + random_count});
 	}
 
+	// the ranges of the whole run, identifying it in the shard results
+	const auto all_seed_ranges = seed_ranges;
+	std::uint32_t shard_index{};
+	std::uint32_t shard_count{};
+	if (shard.isSet()) {
+		const auto& expr = shard.getValue();
+		auto slash = expr.find('/');
+		if (slash == std::string::npos) {
+			throw std::invalid_argument{
+			    concat("Invalid shard ", kblib::quoted(expr))};
+		}
+		shard_index = parse_int<std::uint32_t>(expr.substr(0, slash));
+		shard_count = parse_int<std::uint32_t>(expr.substr(slash + 1));
+		if (shard_index >= shard_count) {
+			throw std::invalid_argument{
+			    concat("Invalid shard ", kblib::quoted(expr))};
+		}
+		if (not seed_ranges.empty()) {
+			seed_ranges = shard_ranges(seed_ranges, shard_index, shard_count);
+		}
+	}
+
 	std::uint32_t total_random_tests{};
 	{
 		auto log = log_debug();
@@ -446,18 +918,53 @@ int main(int argc, char** argv) try {
 	}
 #if TIS_ENABLE_LUA
 	else if (custom_spec_arg.isSet()) {
-		global_level = std::make_unique<custom_level>(custom_spec_arg.getValue());
+		global_level = std::make_unique<custom_level>(custom_spec_arg.getValue(),
+		                                              spec_cache.getValue());
 	}
 #endif
+	std::optional<seed_catalogue> catalogue;
+	if (seed_catalogue_arg.isSet()) {
+		catalogue = read_seed_catalogue(seed_catalogue_arg.getValue());
+		if (global_level and not id_arg.isSet()) {
+			log_warn("--seed-catalogue only has seeds for builtin levels");
+		}
+	}
 
 	if (dry_run.getValue()) {
 		return exit_code::SUCCESS;
 	}
 
+	std::unique_ptr<trace_writer> trace;
+	if (trace_file.isSet()) {
+		trace = std::make_unique<trace_writer>(trace_file.getValue());
+	}
+
+	std::optional<json_writer> json;
+	if (json_arg.isSet() or json_tests.isSet()) {
+		json.emplace(std::cout, json_tests.isSet());
+	}
+	// the JSON output replaces all the text on stdout
+	const int quiet_level = json ? 2 : quiet.getValue();
+
 	exit_code return_code = exit_code::SUCCESS;
 	bool break_filenames = false;
-	for (auto& solution : solutions.getValue()) {
-		if (solutions.getValue().size() > 1) {
+	// with --tar, how the scores compare with the names of the saves
+	std::size_t as_named{};
+	std::size_t not_as_named{};
+	std::size_t failed{};
+	auto solution_error = [&](const std::string& message) {
+		log_err(message);
+		if (json) {
+			json->record("solution").add("error", message);
+		}
+		return_code = exit_code::EXCEPTION;
+		// the save couldn't even be run
+		++failed;
+	};
+	for (const auto& [solution, contents] : inputs) try {
+		if (json) {
+			json->solution = solution;
+		} else if (inputs.size() > 1) {
 			if (std::exchange(break_filenames, true)) {
 				std::cout << '\n';
 			}
@@ -466,55 +973,98 @@ int main(int argc, char** argv) try {
 
 		level* l;
 		std::unique_ptr<level> level_from_name;
+		// identifies the level in the shard results
+		std::string level_key;
+		// the seeds to run first, from the catalogue
+		std::span<const std::uint32_t> first_seeds;
 		if (global_level) {
 			l = global_level.get();
-		} else if (auto filename
-		           = std::filesystem::path(solution).filename().string();
-		           auto maybe_id = guess_level_id(filename)) {
+#if TIS_ENABLE_LUA
+			level_key = id_arg.isSet() ? id_arg.getValue()
+			                           : custom_spec_arg.getValue();
+#else
+			level_key = id_arg.getValue();
+#endif
+			if (catalogue and id_arg.isSet()) {
+				first_seeds = catalogue->seeds(
+				    builtin_layouts[find_level_id(id_arg.getValue())].segment);
+			}
+		} else if (auto maybe_id = deduce_level_id(solution)) {
 			level_from_name = std::make_unique<builtin_level>(*maybe_id);
 			l = level_from_name.get();
+			level_key = builtin_layouts[*maybe_id].segment;
+			if (catalogue) {
+				first_seeds = catalogue->seeds(level_key);
+			}
 			log_debug("Deduced level ", builtin_layouts[*maybe_id].segment,
-			          " from filename ", kblib::quoted(filename));
+			          " from path ", kblib::quoted(solution));
 		} else {
-			log_err("Impossible to determine the level ID for ",
-			        kblib::quoted(filename));
-			return_code = exit_code::EXCEPTION;
+			solution_error(concat("Impossible to determine the level ID for ",
+			                      kblib::quoted(solution)));
 			continue;
 		}
 		field f = l->new_field(T30_size.getValue());
 
 		std::string code;
-		if (solution == "-") {
+		if (contents) {
+			code = *contents;
+		} else if (solution == "-") {
 			std::ostringstream in;
 			in << std::cin.rdbuf();
 			code = std::move(in).str();
 		} else if (std::filesystem::is_regular_file(solution)) {
 			code = kblib::try_get_file_contents(solution, std::ios::in);
 		} else {
-			log_err("invalid file: ", kblib::quoted(solution));
-			return_code = exit_code::EXCEPTION;
+			solution_error(concat("invalid file: ", kblib::quoted(solution)));
 			continue;
 		}
 
 		try {
 			parse_code(f, code, T21_size.getValue());
 		} catch (const std::invalid_argument& e) {
-			log_err(e.what());
-			return_code = exit_code::EXCEPTION;
+			solution_error(e.what());
 			continue;
 		}
 
 		log_debug_r([&] { return "Layout:\n" + f.layout(); });
 
+		if (inspect_test.isSet()) {
+			std::optional<single_test> test;
+			if (inspect_test.getValue() == 0) {
+				test = l->random_test(seed_arg.getValue().val);
+				if (not test) {
+					solution_error(concat("No random test for seed ",
+					                      seed_arg.getValue().val));
+					continue;
+				}
+			} else {
+				test = l->static_suite()[inspect_test.getValue() - 1];
+			}
+			set_expected(f, *test);
+			inspect(f, cycles_limit, snapshot_interval.getValue(), std::cin,
+			        std::cout);
+			continue;
+		}
+
 		score sc{};
 		std::size_t total_cycles{};
 		sc.validated = true;
 		auto random_limit = cycles_limit;
 		if (fixed.getValue()) {
 			int succeeded{1};
-			for (auto test : l->static_suite()) {
-				set_expected(f, std::move(test));
-				score last = run(f, cycles_limit, true);
+			for (const auto& test : l->static_suite()) {
+				set_expected(f, test);
+				std::optional<perf_counters> counters;
+				if (perf.getValue()) {
+					counters.emplace().start();
+				}
+				score last = run(f, cycles_limit, not json, trace.get(),
+				                 num_test_threads);
+				if (counters) {
+					auto sample = counters->stop();
+					sample.sim_cycles = last.cycles;
+					log_notice("fixed test ", succeeded, ": ", to_string(sample));
+				}
 				sc.cycles = std::max(sc.cycles, last.cycles);
 				sc.instructions = last.instructions;
 				sc.nodes = last.nodes;
@@ -524,6 +1074,13 @@ int main(int argc, char** argv) try {
 					break;
 				}
 				total_cycles += last.cycles;
+				if (json and json->tests) {
+					json->record("fixed_test")
+					    .add("test", succeeded)
+					    .add("cycles", last.cycles)
+					    .add("validated", last.validated)
+					    .add("timeout", last.cycles == cycles_limit);
+				}
 				log_info("fixed test ", succeeded, ' ',
 				         last.validated ? "validated"sv : "failed"sv, " in ",
 				         last.cycles, " cycles");
@@ -539,7 +1096,12 @@ int main(int argc, char** argv) try {
 				}
 			}
 			sc.achievement = sc.validated and l->has_achievement(f, sc);
-			validation_summary(sc, succeeded, quiet.getValue(), cycles_limit);
+			validation_summary(sc, succeeded, quiet_level, cycles_limit);
+#if TIS_ENABLE_PROFILE
+			if (profile.getValue()) {
+				std::cout << f.profile_report(color_stdout);
+			}
+#endif
 			random_limit = std::min(
 			    cycles_limit, static_cast<size_t>(static_cast<double>(sc.cycles)
 			                                      * limit_multiplier.getValue()));
@@ -548,8 +1110,54 @@ int main(int argc, char** argv) try {
 
 		uint count = 0;
 		uint valid_count = 0;
-		if ((fixed.getValue() == 0 or sc.validated or stats.getValue())
-		    and not stop_requested and not seed_ranges.empty()) {
+		shard_result partial;
+		partial.shard = shard_index;
+		partial.shard_count = shard_count;
+		partial.fixed_run = fixed.getValue();
+		partial.fixed = sc;
+		partial.fixed_cycles = total_cycles;
+		partial.cheat_rate = cheat_rate.getValue();
+		// identifies the level, solution, seeds and options of the run, so that
+		// checkpoints and shard results are only combined with the same run
+		std::string fingerprint = concat(level_key, '\0', code, '\0');
+		for (auto r : all_seed_ranges) {
+			append(fingerprint, r.begin, ':', r.end, ',');
+		}
+		append(fingerprint, '\0', fixed.getValue(), ' ', cycles_limit, ' ',
+		       limit_multiplier.getValue(), ' ', cheat_rate.getValue(), ' ',
+		       T21_size.getValue(), ' ', T30_size.getValue().val);
+		partial.fingerprint = kblib::FNV64a(fingerprint);
+		if (hunt.isSet()) {
+			if ((fixed.getValue() == 0 or sc.validated) and not stop_requested) {
+				auto hunt_threads
+				    = threads.isSet()
+				          ? num_threads
+				          : std::max(1u, std::thread::hardware_concurrency());
+				auto failures
+				    = hunt_failing_seeds(*l, f, seed_ranges, random_limit,
+				                         hunt.getValue(), hunt_threads);
+				log_flush();
+				for (auto& failure : failures) {
+					if (json) {
+						json->record("failing_seed")
+						    .add("seed", failure.seed)
+						    .add("cycles", failure.cycles)
+						    .add("timeout", failure.timeout);
+					} else {
+						std::cout << "failing seed " << failure.seed << " after "
+						          << failure.cycles << " cycles"
+						          << (failure.timeout ? " [timeout]" : "") << '\n';
+					}
+				}
+				if (failures.empty() and not stop_requested and quiet_level < 2) {
+					std::cout << "no failing seed found\n";
+				}
+				sc.cheat = not failures.empty();
+			}
+		} else if ((fixed.getValue() == 0 or sc.validated or stats.getValue()
+		            or shard.isSet())
+		           and not stop_requested and not all_seed_ranges.empty()) {
+			partial.random_run = true;
 			bool failure_printed{};
 			run_params params{total_cycles,
 			                  failure_printed,
@@ -559,8 +1167,31 @@ int main(int argc, char** argv) try {
 			                  random_limit,
 			                  static_cast<uint>(cheat_rate * total_random_tests),
 			                  static_cast<uint8_t>(quiet.getValue()),
-			                  stats.getValue()};
-			auto worst = run_seed_ranges(*l, f, seed_ranges, params, num_threads);
+			                  stats.getValue() or shard.isSet(),
+			                  perf.getValue(),
+			                  trace.get(),
+			                  checkpoint.getValue(),
+			                  resume.getValue(),
+			                  &partial.failing_seeds,
+			                  json ? &*json : nullptr,
+			                  cycle_histograms.getValue(),
+			                  partial.fingerprint};
+			// the order only matters when the tests can stop at the first
+			// failure, and all the seeds are tested anyway
+			auto ordered_ranges = seed_ranges;
+			if (not first_seeds.empty() and not params.stats) {
+				ordered_ranges = prioritize_seeds(seed_ranges, first_seeds);
+				log_info("Running the catalogue's seeds first");
+			}
+			// a shard can be empty if there are more shards than seeds
+			auto worst = seed_ranges.empty()
+			                 ? score{}
+			                 : run_seed_ranges(*l, f, ordered_ranges, params,
+			                                   num_threads);
+			partial.count = count;
+			partial.valid_count = valid_count;
+			partial.random_cycles = total_cycles - partial.fixed_cycles;
+			partial.worst = worst;
 
 			log_info("Random test results: ", valid_count, " passed out of ",
 			         count, " total");
@@ -570,37 +1201,59 @@ int main(int argc, char** argv) try {
 				if (not sc.validated) {
 					sc.cycles = total_cycles;
 				}
-				validation_summary(sc, -1, quiet.getValue(), random_limit);
+				validation_summary(sc, -1, quiet_level, random_limit);
 			}
 			sc.cheat = (count == 0 or count != valid_count);
 			sc.hardcoded = (valid_count <= static_cast<uint>(count * cheat_rate));
 		}
 
-		log_flush();
-		if (not quiet.getValue()) {
-			std::cout << "score: ";
+		if (shard.isSet()) {
+			partial.complete = not stop_requested;
+			std::ranges::sort(partial.failing_seeds);
+			write_shard_result(shard_result_file.getValue(), partial);
 		}
-		std::cout << to_string(sc);
-		if (count > 0 and stats.isSet()) {
-			const auto rate = 100. * valid_count / count;
-			std::cout << " PR: ";
-			if (valid_count == count) {
-				std::cout << print_escape(bright_blue, bold);
-			} else if (rate >= 100 * cheat_rate) {
-				std::cout << print_escape(yellow);
-			} else {
-				std::cout << print_escape(bright_red);
+
+		std::optional<std::string> named_score;
+		if (tar.isSet()) {
+			named_score = score_from_name(
+			    std::filesystem::path(solution).filename().string());
+		}
+		if (json) {
+			auto r = json->record("solution");
+			json_writer::add_score(r, sc);
+			r.add("random_tests", count).add("random_passed", valid_count);
+			if (named_score) {
+				r.add("named_score", *named_score);
 			}
-			std::cout << rate << '%' << print_escape(none) << " (" << valid_count
-			          << '/' << count << ")";
+		} else {
+			print_score(sc, count, valid_count, stats.isSet(), quiet.getValue(),
+			            cheat_rate.getValue());
 		}
-		std::cout << std::endl;
 		if (not sc.validated) {
+			++failed;
+			return_code = std::max(return_code, exit_code::FAILURE);
+		} else if (named_score and *named_score != to_string(sc, false)) {
+			++not_as_named;
+			if (not json) {
+				std::cout << "score in the name: " << *named_score << '\n';
+			}
 			return_code = std::max(return_code, exit_code::FAILURE);
+		} else if (named_score) {
+			++as_named;
 		}
 		if (stop_requested) {
 			break;
 		}
+	} catch (const std::runtime_error& e) {
+		// such as a T30 over the storage budget, which only stops this save
+		solution_error(concat(kblib::quoted(solution), ": ", e.what()));
+	}
+	if (tar.isSet() and not json and quiet_level < 2) {
+		std::cout << "\n"
+		          << inputs.size() << " saves tested: " << as_named
+		          << " validated with the score in their name, "
+		          << not_as_named << " with a different score, " << failed
+		          << " failed\n";
 	}
 
 	return return_code;
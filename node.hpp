@@ -190,6 +190,21 @@ constexpr inline std::string to_string(node::type_t type) {
 	}
 }
 
+#if TIS_ENABLE_PROFILE
+/// Utilization counters of a regular node, accumulated over every test run on
+/// it
+struct node_profile {
+	/// cycles spent in each activity, indexed by etoi(activity)
+	std::array<std::size_t, 4> cycles{};
+	/// words read from each direction
+	std::array<std::size_t, 2 * DIMENSIONS> words_in{};
+	/// words written toward each direction
+	std::array<std::size_t, 2 * DIMENSIONS> words_out{};
+	/// maximum amount of values held at once (T30 only)
+	std::size_t peak_depth{};
+};
+#endif
+
 struct regular_node : node {
 	virtual ~regular_node() = default;
 
@@ -202,6 +217,10 @@ struct regular_node : node {
 	/// only useful nodes are linked, other links from-to are nullptr
 	std::array<node*, 2 * DIMENSIONS> neighbors{};
 
+#if TIS_ENABLE_PROFILE
+	node_profile profile;
+#endif
+
  protected:
 	using node::node;
 	/// Attempt to read a value from p, coming from this node
@@ -211,7 +230,20 @@ struct regular_node : node {
 		if (not n) {
 			return word_empty;
 		} else {
+#if TIS_ENABLE_PROFILE
+			auto r = n->emit(invert(p));
+			if (r != word_empty) {
+				++profile.words_in[to_unsigned(etoi(p))];
+				// input nodes are not profiled
+				if (n->type == T21 or n->type == T30) {
+					++static_cast<regular_node*>(n)
+					      ->profile.words_out[to_unsigned(etoi(invert(p)))];
+				}
+			}
+			return r;
+#else
 			return n->emit(invert(p));
+#endif
 		}
 	}
 };
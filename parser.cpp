@@ -24,9 +24,11 @@
 #include <kblib/convert.h>
 #include <kblib/stringops.h>
 
-#include <map>
-#include <ranges>
-#include <set>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <optional>
+#include <vector>
 
 std::string_view pop(std::string_view& str, std::size_t n) {
 	n = std::min(n, str.size());
@@ -35,17 +37,146 @@ std::string_view pop(std::string_view& str, std::size_t n) {
 	return r;
 }
 
+namespace {
+
+/// Up to N elements stored inline, spilling to the heap beyond that, which
+/// only happens for saves well beyond the game's limits
+template <typename T, std::size_t N>
+class inline_table {
+ public:
+	void push_back(const T& v) {
+		if (count < N) {
+			fixed[count] = v;
+		} else {
+			spill.push_back(v);
+		}
+		++count;
+	}
+	const T* find_if(auto pred) const {
+		for (std::size_t i = 0; i != std::min(count, N); ++i) {
+			if (pred(fixed[i])) {
+				return &fixed[i];
+			}
+		}
+		for (auto& v : spill) {
+			if (pred(v)) {
+				return &v;
+			}
+		}
+		return nullptr;
+	}
+
+ private:
+	std::array<T, N> fixed{};
+	std::size_t count{};
+	std::vector<T> spill;
+};
+
+/// Flags for the indices below size(), the first N stored inline, like
+/// inline_table, so only layouts far larger than the game's allocate
+template <std::size_t N>
+class flag_set {
+ public:
+	explicit flag_set(std::size_t size)
+	    : size_(size) {
+		if (size > N) {
+			spill.resize(size - N);
+		}
+	}
+	std::size_t size() const { return size_; }
+	/// @returns the old value of flag i
+	bool test_and_set(std::size_t i) {
+		bool old;
+		if (i < N) {
+			old = fixed.test(i);
+			fixed.set(i);
+		} else {
+			old = spill[i - N];
+			spill[i - N] = true;
+		}
+		return old;
+	}
+
+ private:
+	std::bitset<N> fixed;
+	std::vector<bool> spill;
+	std::size_t size_;
+};
+
+/// Splits a line of assembly into tokens separated by spaces, tabs and
+/// commas, dropping the comment. Tokens are views into the line.
+class tokenizer {
+ public:
+	explicit tokenizer(std::string_view line)
+	    // Apparently the game allows ! anywhere as long as there's only one,
+	    // and treats it as a space
+	    : bang(line.find_first_of('!'))
+	    , line(line.substr(0, line.find_first_of('#'))) {}
+
+	std::optional<std::string_view> next() {
+		while (pos != line.size() and is_separator(pos)) {
+			++pos;
+		}
+		if (pos == line.size()) {
+			return std::nullopt;
+		}
+		auto begin = pos;
+		while (pos != line.size() and not is_separator(pos)) {
+			++pos;
+		}
+		return line.substr(begin, pos - begin);
+	}
+
+ private:
+	bool is_separator(std::size_t i) const {
+		return i == bang or " \t,"sv.contains(line[i]);
+	}
+
+	std::size_t bang;
+	std::string_view line;
+	std::size_t pos{};
+};
+
+/// Call fn on each line of source, without the newlines
+void for_each_line(std::string_view source, auto fn) {
+	while (true) {
+		auto end = source.find_first_of('\n');
+		fn(source.substr(0, end));
+		if (end == source.npos) {
+			return;
+		}
+		source.remove_prefix(end + 1);
+	}
+}
+
+struct label {
+	std::string_view name;
+	word_t target;
+};
+
+} // namespace
+
 void parse_code(field& f, std::string_view source, std::size_t T21_size) {
 	source.remove_prefix(std::min(source.find_first_of('@'), source.size()));
-	std::set<int> nodes_seen;
+	// labels of existing nodes are checked in a table, others can only have
+	// empty sections
+	flag_set<64> nodes_seen(f.t21_count());
+	inline_table<int, 16> other_labels_seen;
 	while (not source.empty()) {
 		auto header = pop(source, source.find_first_of('\n'));
 		pop(source, source.find_first_not_of(" \t\r\n"));
 		header.remove_prefix(1);
 		auto i = kblib::parse_integer<int>(header);
 		auto section = pop(source, source.find_first_of('@'));
-		if (not nodes_seen.insert(i).second) {
-			throw std::invalid_argument{concat("duplicate node label ", i)};
+		if (i >= 0 and std::cmp_less(i, nodes_seen.size())) {
+			if (nodes_seen.test_and_set(to_unsigned(i))) {
+				throw std::invalid_argument{concat("duplicate node label ", i)};
+			}
+		} else {
+			if (other_labels_seen.find_if([&](int n) { return n == i; })) {
+				throw std::invalid_argument{concat("duplicate node label ", i)};
+			}
+			other_labels_seen.push_back(i);
 		}
 		if (section.empty()) {
 			continue;
@@ -63,7 +194,7 @@ void parse_code(field& f, std::string_view source, std::size_t T21_size) {
 	f.finalize_nodes();
 }
 
-void set_expected(field& f, single_test&& expected) {
+void set_expected(field& f, const single_test& expected) {
 	for (auto& i : f.regulars()) {
 		auto p = i.get();
 		log_debug("reset node (", p->x, ',', p->y, ')');
@@ -82,24 +213,24 @@ void set_expected(field& f, single_test&& expected) {
 	using std::views::zip;
 	for (const auto& [n, i] : zip(f.inputs(), expected.inputs)) {
 		log_debug("reset input I", n->x);
-		n->reset(std::move(i));
+		n->reset(i);
 		auto debug = log_debug();
 		debug << "set expected input I" << n->x << ":";
 		write_list(debug, n->inputs);
 	}
 	for (const auto& [n, o] : zip(f.numerics(), expected.n_outputs)) {
 		log_debug("reset output O", n->x);
-		n->reset(std::move(o));
+		n->reset(o);
 		auto debug = log_debug();
 		debug << "set expected output O" << n->x << ":";
 		write_list(debug, n->outputs_expected);
 	}
 	for (const auto& [n, i] : zip(f.images(), expected.i_outputs)) {
 		log_debug("reset image O", n->x);
-		n->reset(std::move(i));
+		n->reset(i);
 		auto debug = log_debug();
 		debug << "set expected image O" << n->x << ": {\n";
-		debug.log_r([&] { return n->image_expected.write_text(color_logs); });
+		debug.log_r([&] { return n->image_expected->write_text(color_logs); });
 		debug << '}';
 	}
 }
@@ -198,21 +329,17 @@ port parse_port(std::string_view str) {
 
 std::vector<instr> assemble(std::string_view source, int node,
                             std::size_t T21_size) {
-	auto lines = kblib::split_dsv(source, '\n');
-	if (lines.size() > T21_size) {
+	auto line_count = to_unsigned(std::ranges::count(source, '\n')) + 1;
+	if (line_count > T21_size) {
 		throw std::invalid_argument{concat("too many lines of asm for node ",
-		                                   node, "; ", lines.size(),
+		                                   node, "; ", line_count,
 		                                   " exceeds limit ", T21_size)};
 	}
-	std::vector<instr> ret;
-	std::map<std::string, word_t, std::less<>> labels;
+	// views into source
+	inline_table<label, 32> labels;
 
 	int l{};
-	for (auto& line : lines) {
-		// Apparently the game allows ! anywhere as long as there's only one
-		if (auto bang = line.find_first_of('!'); bang != std::string::npos) {
-			line[bang] = ' ';
-		}
+	for_each_line(source, [&](std::string_view line) {
 		for (auto c : line) {
 			// the game won't let you type '`' or '\t' but (sort of) handles
 			// them in saves. Same with '@' not followed by a digit but that
@@ -223,81 +350,82 @@ std::vector<instr> assemble(std::string_view source, int node,
 				    ", character ", kblib::escapify(c), " not allowed in source")};
 			}
 		}
-		auto tokens
-		    = kblib::split_tokens(line.substr(0, line.find_first_of('#')),
-		                          [](char c) { return " \t,"sv.contains(c); });
 		// the game allows only a single label per line, but multiple labels can
 		// still be attached to the same instruction if put in different lines, we
 		// simply allow multiple labels per line
-		for (const auto& tok : tokens) {
-			assert(not tok.empty());
-			std::string tmp;
-			for (auto c : tok) {
-				if (c == ':') {
-					if (tmp.empty()) {
-						throw std::invalid_argument{
-						    concat('@', node, ':', l, ": Invalid label \"\"")};
-					}
-					if (labels.contains(tmp)) {
-						throw std::invalid_argument{
-						    concat('@', node, ':', l, ": Label ", kblib::quoted(tmp),
-						           " defined multiple times")};
-					}
-					log_debug("L: ", tmp, " (", l, ")");
-					labels[std::exchange(tmp, "")] = to_word(l);
-				} else {
-					tmp.push_back(c);
+		tokenizer tokens(line);
+		while (auto tok = tokens.next()) {
+			for (auto colon = tok->find_first_of(':'); colon != tok->npos;
+			     colon = tok->find_first_of(':')) {
+				auto name = pop(*tok, colon);
+				tok->remove_prefix(1);
+				if (name.empty()) {
+					throw std::invalid_argument{
+					    concat('@', node, ':', l, ": Invalid label \"\"")};
 				}
+				if (labels.find_if([&](const label& lb) { return lb.name == name; })) {
+					throw std::invalid_argument{
+					    concat('@', node, ':', l, ": Label ", kblib::quoted(name),
+					           " defined multiple times")};
+				}
+				log_debug("L: ", name, " (", l, ")");
+				labels.push_back({name, to_word(l)});
 			}
-			if (not tmp.empty()) {
+			if (not tok->empty()) {
 				++l;
 				break;
 			}
 		}
-	}
+	});
 
+	std::vector<instr> ret;
+	ret.reserve(to_unsigned(l));
 	l = 0;
-	for (const auto& line : lines) {
+	for_each_line(source, [&](std::string_view line) {
+		// an opcode and up to 3 operands, the last only to report it
+		std::array<std::string_view, 4> tokens;
+		std::size_t token_count{};
 		bool seen_op{false};
-		auto tokens
-		    = kblib::split_tokens(line.substr(0, line.find_first_of('#')),
-		                          [](char c) { return " \t,"sv.contains(c); });
-		// remove labels
-		for (auto& tok : tokens) {
-			if (tok.contains(':')) {
+		tokenizer lexer(line);
+		while (auto tok = lexer.next()) {
+			// remove labels
+			if (tok->contains(':')) {
 				if (seen_op) {
 					throw std::invalid_argument{concat(
 					    '@', node, ':', l, ": Labels must be first on a line")};
 				}
-				tok = tok.substr(tok.find_last_of(':') + 1);
+				tok->remove_prefix(tok->find_last_of(':') + 1);
 			}
-			if (not tok.empty()) {
+			if (not tok->empty()) {
 				seen_op = true;
+				if (token_count < tokens.size()) {
+					tokens[token_count] = *tok;
+				}
+				++token_count;
 			}
 		}
-		std::erase(tokens, "");
 
 		auto assert_last_operand = [&](std::size_t j) {
-			if (tokens.size() < j + 1) {
+			if (token_count < j + 1) {
 				throw std::invalid_argument{
 				    concat('@', node, ':', l, ": Expected operand")};
 			}
-			if (tokens.size() > j + 1) {
+			if (token_count > j + 1) {
 				throw std::invalid_argument{concat('@', node, ':', l,
 				                                   ": Unexpected operand ",
 				                                   kblib::quoted(tokens[j + 1]))};
 			}
 		};
-		auto parse_label = [&](std::string_view label) -> word_t {
-			auto it = labels.find(label);
-			if (it != labels.end()) {
-				return it->second;
+		auto parse_label = [&](std::string_view name) -> word_t {
+			if (auto lb = labels.find_if(
+			        [&](const label& lb) { return lb.name == name; })) {
+				return lb->target;
 			}
 			throw std::invalid_argument{concat('@', node, ':', l, ": Label ",
-			                                   kblib::quoted(label),
+			                                   kblib::quoted(name),
 			                                   " used but not defined")};
 		};
-		auto load_port_or_immediate = [&](instr& i, const std::string& token) {
+		auto load_port_or_immediate = [&](instr& i, std::string_view token) {
 			if ("+-0123456789"sv.contains(token.front())) {
 				// the game accepts int32 immediates and clamps them to [min, max],
 				// the sim enforces the limit in the source directly
@@ -313,8 +441,8 @@ std::vector<instr> assemble(std::string_view source, int node,
 				i.src = parse_port(token);
 			}
 		};
-		if (not tokens.empty()) {
-			auto& opcode = tokens[0];
+		if (token_count != 0) {
+			auto opcode = tokens[0];
 			instr i{};
 			using enum instr::op;
 			if (opcode == "HCF") {
@@ -378,7 +506,7 @@ std::vector<instr> assemble(std::string_view source, int node,
 			ret.push_back(i);
 		}
 		++l;
-	}
+	});
 
 	// normalize labels at the end of the code
 	for (auto& i : ret) {
@@ -0,0 +1,188 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef PERF_HPP
+#define PERF_HPP
+
+#include "logger.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#ifdef __linux__
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+/// Host hardware counters measured while simulating
+struct perf_sample {
+	/// simulated cycles run while measuring, filled by the caller
+	std::size_t sim_cycles{};
+	std::chrono::nanoseconds time{};
+	std::uint64_t instructions{};
+	std::uint64_t cycles{};
+	std::uint64_t branch_misses{};
+	std::uint64_t cache_misses{};
+
+	perf_sample& operator+=(const perf_sample& o) noexcept {
+		sim_cycles += o.sim_cycles;
+		time += o.time;
+		instructions += o.instructions;
+		cycles += o.cycles;
+		branch_misses += o.branch_misses;
+		cache_misses += o.cache_misses;
+		return *this;
+	}
+};
+
+/// Hardware counters of the calling thread, using perf_event_open on Linux.
+/// Elsewhere, or when the kernel refuses access, only the time is measured.
+class perf_counters {
+ public:
+	perf_counters() {
+#ifdef __linux__
+		constexpr std::array<std::uint64_t, 4> configs{
+		    PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+		    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+		for (auto i : range(fds.size())) {
+			perf_event_attr attr{};
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = configs[i];
+			attr.disabled = 1;
+			// allows use with the default perf_event_paranoid setting
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[i] = static_cast<int>(
+			    syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		}
+#endif
+		if (not good()) {
+			static std::once_flag warned;
+			std::call_once(warned, [] {
+				log_warn("Hardware performance counters unavailable, only "
+				         "timing will be reported");
+			});
+		}
+	}
+	perf_counters(const perf_counters&) = delete;
+	perf_counters& operator=(const perf_counters&) = delete;
+	~perf_counters() {
+#ifdef __linux__
+		for (auto fd : fds) {
+			if (fd != -1) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	/// true if at least one hardware counter is available
+	bool good() const noexcept {
+		return std::ranges::any_of(fds, [](int fd) { return fd != -1; });
+	}
+
+	void start() noexcept {
+#ifdef __linux__
+		for (auto fd : fds) {
+			if (fd != -1) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+		start_time = std::chrono::steady_clock::now();
+	}
+
+	perf_sample stop() noexcept {
+		perf_sample ret;
+		ret.time = std::chrono::steady_clock::now() - start_time;
+#ifdef __linux__
+		std::array<std::uint64_t, 4> values{};
+		for (auto i : range(fds.size())) {
+			if (fds[i] != -1) {
+				ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fds[i], &values[i], sizeof(values[i]))
+				    != sizeof(values[i])) {
+					values[i] = 0;
+				}
+			}
+		}
+		ret.instructions = values[0];
+		ret.cycles = values[1];
+		ret.branch_misses = values[2];
+		ret.cache_misses = values[3];
+#endif
+		return ret;
+	}
+
+ private:
+	std::array<int, 4> fds{-1, -1, -1, -1};
+	std::chrono::steady_clock::time_point start_time;
+};
+
+/// Measures the calling thread for its whole lifetime and stores the result
+/// in a sample, keeping the simulated cycles counted by the caller
+class perf_scope {
+ public:
+	perf_scope(perf_sample& out)
+	    : out(out) {
+		counters.start();
+	}
+	~perf_scope() {
+		auto s = counters.stop();
+		s.sim_cycles = out.sim_cycles;
+		out = s;
+	}
+
+ private:
+	perf_counters counters;
+	perf_sample& out;
+};
+
+inline std::string to_string(const perf_sample& s) {
+	auto seconds = std::chrono::duration<double>(s.time).count();
+	auto per_cycle = [&](std::uint64_t v) {
+		return s.sim_cycles ? static_cast<double>(v)
+		                          / static_cast<double>(s.sim_cycles)
+		                    : 0.;
+	};
+	std::string ret
+	    = concat(s.sim_cycles, " cycles in ", seconds * 1000, " ms (",
+	             seconds > 0 ? static_cast<double>(s.sim_cycles) / seconds : 0.,
+	             " cycles/s)");
+	if (s.instructions or s.cycles) {
+		append(ret, "; host: ", s.instructions, " instructions (",
+		       per_cycle(s.instructions), "/cycle), ", s.cycles, " cycles (IPC ",
+		       s.cycles ? static_cast<double>(s.instructions)
+		                      / static_cast<double>(s.cycles)
+		                : 0.,
+		       "), ", s.branch_misses, " branch-misses (",
+		       per_cycle(s.branch_misses), "/cycle), ", s.cache_misses,
+		       " cache-misses (", per_cycle(s.cache_misses), "/cycle)");
+	}
+	return ret;
+}
+
+#endif // PERF_HPP
@@ -19,21 +19,71 @@
 #define RUNNER_HPP
 
 #include "field.hpp"
+#include "histogram.hpp"
+#include "json.hpp"
 #include "levels.hpp"
 #include "logger.hpp"
 #include "node.hpp"
 #include "parser.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <barrier>
+#include <chrono>
 #include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <sstream>
 #include <thread>
 
 inline std::atomic<std::sig_atomic_t> stop_requested;
 
+/// At log level trace, print the state of the whole field only before the
+/// first cycle of a test, and then only the nodes that changed in each cycle
+inline bool trace_deltas{false};
+
 extern "C" inline void sigterm_handler(int signal) { stop_requested = signal; }
 
+/// The first exception thrown by a group of threads, other than HCF which
+/// run() handles, to rethrow once they're joined instead of terminating. The
+/// other threads of the group should poll cancelled() to stop early.
+class thread_error {
+ public:
+	void run(auto&& fn) noexcept {
+		try {
+			fn();
+		} catch (...) {
+			std::unique_lock lock(m);
+			if (not error) {
+				error = std::current_exception();
+			}
+			failed.store(true, std::memory_order_relaxed);
+		}
+	}
+	/// Whether a thread of the group has thrown
+	bool cancelled() const noexcept {
+		return failed.load(std::memory_order_relaxed);
+	}
+	void rethrow() const {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+ private:
+	std::mutex m;
+	std::exception_ptr error;
+	std::atomic<bool> failed{};
+};
+
 template <typename T>
 void print_validation_failure(const field& f, T&& os, bool color) {
 	for (auto& i : f.inputs()) {
@@ -56,28 +106,154 @@ void print_validation_failure(const field& f, T&& os, bool color) {
 			   << p->width << ',' << p->height << ")\n"
 			   << p->image_received.write_text(color) //
 			   << "expected:\n"
-			   << p->image_expected.write_text(color);
+			   << p->image_expected->write_text(color);
 		}
 	}
 }
 
-inline score run(field& f, size_t cycles_limit, bool print_err) {
-	score sc{};
-	sc.instructions = f.instructions();
-	sc.nodes = f.nodes_used();
-	try {
+namespace detail {
+/// The simulation loop, instantiated for each logging policy and step kernel.
+/// With logger, a new debug message is built for each cycle, other sinks are
+/// reused. Only the log-free loop uses the unrolled kernels.
+template <typename Log>
+[[gnu::always_inline]] inline void run_loop(field& f, score& sc,
+                                            size_t cycles_limit, Log* sink) {
+	auto loop = [&](auto kernel) {
 		bool active;
+		// the state printed last, with trace_deltas
+		std::optional<field::snapshot> printed;
 		do {
 			++sc.cycles;
-			log_trace("step ", sc.cycles);
-			log_trace_r([&] { return "Current state:\n" + f.state(); });
-			active = f.step();
-		} while (
-		    active and sc.cycles < cycles_limit
-		    and not stop_requested // testing the atomic sighandler last is
-		                           // equivalent to relaxed memory order in my
-		                           // tests, testing it sooner loses performance
+			if constexpr (std::same_as<Log, null_logger>) {
+				active = f.step(kernel, *sink);
+			} else {
+				log_trace("step ", sc.cycles);
+				log_trace_r([&] {
+					if (trace_deltas and printed) {
+						return "Changed state:\n" + f.changed_state(*printed);
+					} else if (trace_deltas) {
+						printed = f.save();
+					}
+					return "Current state:\n" + f.state();
+				});
+				if constexpr (std::same_as<Log, trace_writer>) {
+					sink->cycle = static_cast<std::uint32_t>(sc.cycles);
+					active = f.step(kernel, *sink);
+				} else {
+					auto debug = log_debug();
+					active = f.step(kernel, debug);
+				}
+			}
+		} while (active and sc.cycles < cycles_limit
+		         and not stop_requested // testing the atomic sighandler last
+		                                // is equivalent to relaxed memory
+		                                // order in my tests, testing it
+		                                // sooner loses performance
 		);
+	};
+	if constexpr (std::same_as<Log, null_logger>) {
+		f.visit_kernel(loop);
+	} else {
+		// speed doesn't matter with a log or a trace
+		f.visit_generic_kernel(loop);
+	}
+}
+
+/// The log-free simulation loop, with each cycle split between a team of
+/// threads as in plan. The serial phase and the end of cycle checks run in the
+/// barrier completion, while the other threads wait, so the result is the
+/// same as the serial loop's.
+/// @returns whether the field was active in the last cycle
+inline bool run_loop_parallel(field& f, score& sc, size_t cycles_limit,
+                              const field::parallel_plan& plan) {
+	const auto threads = plan.step.size();
+	// the first HCF of each thread and of the serial phase
+	std::vector<std::optional<hcf_exception>> hcfs(threads + 1);
+	thread_error error;
+	auto step = [&](std::span<regular_node* const> nodes, std::size_t i) {
+		error.run([&] {
+			try {
+				field::step_regulars(nodes);
+			} catch (const hcf_exception& e) {
+				if (not hcfs[i]) {
+					hcfs[i] = e;
+				}
+			}
+		});
+	};
+	bool serial_phase = true;
+	bool active = true;
+	bool done = false;
+	std::barrier sync(static_cast<std::ptrdiff_t>(threads), [&]() noexcept {
+		if (serial_phase) {
+			++sc.cycles;
+			step(plan.serial, threads);
+			error.run([&] { active = f.step_io(); });
+		} else {
+			done = not active or sc.cycles >= cycles_limit or stop_requested
+			       or error.cancelled()
+			       or std::ranges::any_of(hcfs, [](auto& h) { return bool(h); });
+		}
+		serial_phase = not serial_phase;
+	});
+	auto work = [&](std::size_t i) {
+		do {
+			step(plan.step[i], i);
+			sync.arrive_and_wait();
+			field::finalize_regulars(plan.finalize[i]);
+			sync.arrive_and_wait();
+		} while (not done);
+	};
+	{
+		std::vector<std::jthread> team;
+		for (auto i : range(std::size_t{1}, threads)) {
+			team.emplace_back(work, i);
+		}
+		work(0);
+	}
+	error.rethrow();
+
+	// the serial loop stops at the first HCF in node order
+	std::optional<hcf_exception> first;
+	for (auto& h : hcfs) {
+		if (h and (not first or std::pair{h->y, h->x} < std::pair{first->y, first->x})) {
+			first = h;
+		}
+	}
+	if (first) {
+		throw *first;
+	}
+	return active;
+}
+} // namespace detail
+
+/// if trace is set, the field steps are recorded into it instead of the debug
+/// log. Below log level trace, a log-free simulation loop is used, which is
+/// split between test_threads threads if the field is large enough.
+inline score run(field& f, size_t cycles_limit, bool print_err,
+                 trace_writer* trace = nullptr, unsigned test_threads = 1) {
+	score sc{};
+	sc.instructions = f.instructions();
+	sc.nodes = f.nodes_used();
+	try {
+		std::optional<field::parallel_plan> plan;
+		if (test_threads > 1 and not trace
+		    and get_log_level() < log_level::trace) {
+			plan = f.plan_parallel(test_threads);
+			if (plan->step.size() < 2) {
+				plan.reset();
+			}
+		}
+		if (plan) {
+			detail::run_loop_parallel(f, sc, cycles_limit, *plan);
+		} else if (trace) {
+			detail::run_loop(f, sc, cycles_limit, trace);
+		} else if (get_log_level() >= log_level::trace) {
+			detail::run_loop<logger>(f, sc, cycles_limit, nullptr);
+		} else {
+			null_logger log;
+			detail::run_loop(f, sc, cycles_limit, &log);
+		}
 
 		sc.validated = true;
 		for (auto& p : f.numerics()) {
@@ -111,6 +287,13 @@ struct range_t {
 	std::uint32_t end{};
 };
 
+/// a range with end <= begin wraps around the seed space, so {0, 0} is all of
+/// it
+inline std::uint64_t range_size(range_t r) noexcept {
+	auto s = static_cast<std::uint32_t>(r.end - r.begin);
+	return s == 0 ? std::uint64_t{1} << 32 : s;
+}
+
 class seed_range_iterator {
  public:
 	using seed_range_t = std::span<const range_t>;
@@ -140,6 +323,22 @@ class seed_range_iterator {
 		++*this;
 		return tmp;
 	}
+	/// Skip n seeds, equivalent to calling ++ n times
+	seed_range_iterator& advance(std::uint64_t n) noexcept {
+		while (n != 0 and it != v_end) {
+			auto left = range_size({cur, it->end});
+			if (n < left) {
+				cur += static_cast<std::uint32_t>(n);
+				return *this;
+			}
+			n -= left;
+			++it;
+			if (it != v_end) {
+				cur = it->begin;
+			}
+		}
+		return *this;
+	}
 
 	struct sentinel {};
 	bool operator==(sentinel) const noexcept { return it == v_end; }
@@ -166,8 +365,214 @@ struct run_params {
 	uint cheating_success_threshold;
 	std::uint8_t quiet;
 	bool stats;
+	bool perf;
+	/// only usable with a single thread
+	trace_writer* trace;
+	/// file to save the progress to, disabled if empty
+	std::string_view checkpoint;
+	/// continue from the checkpoint file if it exists
+	bool resume;
+	/// if not null, collects up to max_recorded_failures failing seeds
+	std::vector<std::uint32_t>* failing_seeds;
+	/// if not null and it wants them, gets a record per seed
+	json_writer* json;
+	/// report the distribution of the cycle counts at the end
+	bool histograms;
+	/// identifies the solution, level and options, a checkpoint is only
+	/// resumed by the same run
+	std::uint64_t fingerprint;
+};
+
+constexpr std::size_t max_recorded_failures = 100;
+
+/// Which seeds of a sweep are complete. Seeds are handed out in order, so
+/// that is a complete prefix plus the seeds completed out of order past it.
+/// Guarded by the seed iterator mutex.
+struct sweep_progress {
+	/// index of the next seed to hand out, over all ranges
+	std::uint64_t next{};
+	/// seeds handed out and not complete yet
+	std::set<std::uint64_t> pending;
+	/// seeds completed past the first pending one
+	std::set<std::uint64_t> done_ahead;
+	std::optional<std::uint32_t> first_failure;
+	std::chrono::steady_clock::time_point last_save
+	    = std::chrono::steady_clock::now();
+
+	/// number of seeds before the first incomplete one
+	std::uint64_t position() const {
+		return pending.empty() ? next : *pending.begin();
+	}
+	void complete(std::uint64_t i) {
+		pending.erase(i);
+		done_ahead.insert(i);
+		done_ahead.erase(done_ahead.begin(), done_ahead.lower_bound(position()));
+	}
 };
 
+constexpr auto checkpoint_interval = std::chrono::seconds(60);
+constexpr std::string_view checkpoint_header = "TIS-100-CXX checkpoint 2";
+
+/// Write the progress of a sweep, replacing the file atomically
+inline void save_checkpoint(const std::string& path,
+                            std::span<const range_t> seed_ranges,
+                            const sweep_progress& progress,
+                            const run_params& params, const score& worst,
+                            const cycle_stats* hist) {
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp, std::ios::trunc);
+		out << checkpoint_header << "\nfingerprint " << params.fingerprint
+		    << "\nranges";
+		for (auto r : seed_ranges) {
+			out << ' ' << r.begin << ':' << r.end;
+		}
+		out << "\nposition " << progress.position() << "\ndone_ahead";
+		for (auto i : progress.done_ahead) {
+			out << ' ' << i;
+		}
+		out << "\ncount " << params.count                        //
+		    << "\nvalid_count " << params.valid_count            //
+		    << "\ntotal_cycles " << params.total_cycles          //
+		    << "\nworst " << worst.cycles << ' ' << worst.nodes //
+		    << ' ' << worst.instructions << ' ' << worst.validated << '\n';
+		if (progress.first_failure) {
+			out << "first_failure " << *progress.first_failure << '\n';
+		}
+		if (params.failing_seeds) {
+			out << "failing_seeds";
+			for (auto seed : *params.failing_seeds) {
+				out << ' ' << seed;
+			}
+			out << '\n';
+		}
+		if (hist) {
+			out << "histogram_passed ";
+			hist->passed.write(out);
+			out << "\nhistogram_timeouts " << hist->timeouts << '\n';
+			for (const auto& [x, h] : hist->failed) {
+				out << "histogram_failed " << x << ' ';
+				h.write(out);
+				out << '\n';
+			}
+		}
+		if (not out.flush()) {
+			throw std::runtime_error{
+			    concat("Cannot write checkpoint ", kblib::quoted(tmp))};
+		}
+	}
+	std::filesystem::rename(tmp, path);
+	log_info("Checkpoint saved at ", progress.position(), " seeds");
+}
+
+/// Restore the progress of a sweep saved by save_checkpoint
+/// @returns false if the file doesn't exist
+/// @throws std::runtime_error if the file is invalid or for another run
+inline bool load_checkpoint(const std::string& path,
+                            std::span<const range_t> seed_ranges,
+                            sweep_progress& progress, run_params& params,
+                            score& worst, cycle_stats* hist) {
+	std::ifstream in(path);
+	if (not in) {
+		return false;
+	}
+	auto invalid = [&](std::string_view what) {
+		return std::runtime_error{
+		    concat("Invalid checkpoint ", kblib::quoted(path), ": ", what)};
+	};
+	std::string line;
+	if (not std::getline(in, line) or line != checkpoint_header) {
+		throw invalid("unknown format");
+	}
+	bool ranges_seen{};
+	bool fingerprint_seen{};
+	while (std::getline(in, line)) {
+		std::istringstream is(line);
+		std::string key;
+		is >> key;
+		if (key == "fingerprint") {
+			fingerprint_seen = true;
+			std::uint64_t fingerprint{};
+			is >> fingerprint;
+			if (is and fingerprint != params.fingerprint) {
+				throw invalid("made for a different solution, level or options");
+			}
+		} else if (key == "ranges") {
+			ranges_seen = true;
+			std::vector<range_t> saved;
+			range_t r;
+			char colon;
+			while (is >> r.begin >> colon >> r.end) {
+				saved.push_back(r);
+			}
+			if (not std::ranges::equal(saved, seed_ranges, {}, &range_t::begin,
+			                           &range_t::begin)
+			    or not std::ranges::equal(saved, seed_ranges, {}, &range_t::end,
+			                              &range_t::end)) {
+				throw invalid("made for different seed ranges");
+			}
+			continue;
+		} else if (key == "position") {
+			is >> progress.next;
+		} else if (key == "done_ahead") {
+			std::uint64_t i;
+			while (is >> i) {
+				progress.done_ahead.insert(i);
+			}
+			continue;
+		} else if (key == "count") {
+			is >> params.count;
+		} else if (key == "valid_count") {
+			is >> params.valid_count;
+		} else if (key == "total_cycles") {
+			is >> params.total_cycles;
+		} else if (key == "worst") {
+			is >> worst.cycles >> worst.nodes >> worst.instructions
+			    >> worst.validated;
+		} else if (key == "first_failure") {
+			is >> progress.first_failure.emplace();
+		} else if (key == "failing_seeds") {
+			std::uint32_t seed;
+			while (is >> seed) {
+				if (params.failing_seeds
+				    and params.failing_seeds->size() < max_recorded_failures) {
+					params.failing_seeds->push_back(seed);
+				}
+			}
+			continue;
+		} else if (key == "histogram_passed") {
+			if (hist and not hist->passed.read(is)) {
+				throw invalid("bad value for histogram_passed");
+			}
+			continue;
+		} else if (key == "histogram_timeouts") {
+			std::uint64_t timeouts{};
+			is >> timeouts;
+			if (hist) {
+				hist->timeouts += timeouts;
+			}
+		} else if (key == "histogram_failed") {
+			int x{};
+			if (not (is >> x) or (hist and not hist->failed[x].read(is))) {
+				throw invalid("bad value for histogram_failed");
+			}
+			continue;
+		} else {
+			throw invalid(concat("unknown key ", kblib::quoted(key)));
+		}
+		if (not is) {
+			throw invalid(concat("bad value for ", key));
+		}
+	}
+	if (not ranges_seen) {
+		throw invalid("no seed ranges");
+	} else if (not fingerprint_seen) {
+		throw invalid("no fingerprint");
+	}
+	params.failure_printed = progress.first_failure.has_value();
+	return true;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunknown-warning-option"
 #pragma GCC diagnostic ignored "-Wshadow=compatible-local"
@@ -180,35 +585,102 @@ inline score run_seed_ranges(level& l, field& f,
 	std::mutex it_m;
 	std::mutex sc_m;
 	std::vector<int> counters(num_threads);
+	std::vector<perf_sample> perf_samples(num_threads);
+	std::vector<cycle_stats> histograms(params.histograms ? num_threads : 0);
+	const bool invariant = f.inputs().empty();
+	sweep_progress progress;
+	if (invariant) {
+		params.checkpoint = {};
+	}
+	std::string checkpoint(params.checkpoint);
+	// with --checkpoint, the counts of the tests done so far, which the
+	// workers fill under the sweep lock instead of their own histograms
+	std::optional<cycle_stats> saved_histogram;
+	if (params.histograms and not params.checkpoint.empty()) {
+		saved_histogram.emplace();
+	}
+	cycle_stats* saved_hist = saved_histogram ? &*saved_histogram : nullptr;
+	if (params.resume and not checkpoint.empty()
+	    and load_checkpoint(checkpoint, seed_ranges, progress, params, worst,
+	                        saved_hist)) {
+		log_notice("Resuming from ", kblib::quoted(checkpoint), " at ",
+		           progress.next, " seeds");
+		seed_it.advance(progress.next);
+	}
 
 	auto task = [](std::mutex& it_m, std::mutex& sc_m,
-	               seed_range_iterator& seed_it, level& l, field f,
-	               run_params params, score& worst, int& counter) static {
+	               seed_range_iterator& seed_it, sweep_progress& progress,
+	               std::span<const range_t> seed_ranges, level& l, field f,
+	               run_params params, score& worst, int& counter,
+	               perf_sample& sample, cycle_stats* hist,
+	               cycle_stats* saved_hist, const thread_error* error,
+	               std::optional<unsigned> log_id) static {
+		std::optional<log_thread_scope> log_scope;
+		if (log_id) {
+			log_scope.emplace(*log_id);
+		}
+		std::optional<perf_scope> perf;
+		if (params.perf) {
+			perf.emplace(sample);
+		}
 		while (true) {
+			// another worker threw
+			if (error and error->cancelled()) {
+				return;
+			}
 			std::uint32_t seed;
+			std::uint64_t index;
 			{
 				std::unique_lock lock(it_m);
+				// skip the seeds completed before resuming
+				while (seed_it != seed_it.end()
+				       and progress.done_ahead.contains(progress.next)) {
+					++seed_it;
+					++progress.next;
+				}
 				if (seed_it == seed_it.end()) {
 					return;
 				} else {
 					seed = *seed_it++;
+					index = progress.next++;
+					progress.pending.insert(index);
 				}
 			}
 
+			set_log_seed(seed);
 			auto test = l.random_test(seed);
 			if (not test) {
+				std::unique_lock lock(it_m);
+				progress.complete(index);
 				continue;
 			}
 			++counter;
-			set_expected(f, std::move(*test));
-			score last = run(f, params.cycles_limit, false);
+			set_expected(f, *test);
+			score last = run(f, params.cycles_limit, false, params.trace);
+			sample.sim_cycles += last.cycles;
 			if (stop_requested) {
 				return;
 			}
+			if (hist and not saved_hist) {
+				hist->record(f, last, params.cycles_limit);
+			}
 
 			// none of this is hot, so it doesn't need to be parallelized
 			// so it's simplest to just hold a lock the whole time
-			std::unique_lock lock(sc_m);
+			std::scoped_lock lock(it_m, sc_m);
+			progress.complete(index);
+			if (saved_hist) {
+				// merged as it's recorded, so that a checkpoint counts every
+				// test it marks as done
+				saved_hist->record(f, last, params.cycles_limit);
+			}
+			if (params.json and params.json->tests) {
+				params.json->record("random_test")
+				    .add("seed", seed)
+				    .add("cycles", last.cycles)
+				    .add("validated", last.validated)
+				    .add("timeout", last.cycles == params.cycles_limit);
+			}
 			++params.count;
 			worst.instructions = last.instructions;
 			worst.nodes = last.nodes;
@@ -219,6 +691,13 @@ inline score run_seed_ranges(level& l, field& f,
 				worst.cycles = std::max(worst.cycles, last.cycles);
 				params.valid_count++;
 			} else {
+				if (not progress.first_failure) {
+					progress.first_failure = seed;
+				}
+				if (params.failing_seeds
+				    and params.failing_seeds->size() < max_recorded_failures) {
+					params.failing_seeds->push_back(seed);
+				}
 				if (std::exchange(params.failure_printed, true) == false) {
 					log_info("Random test failed for seed: ", seed,
 					         last.cycles == params.cycles_limit ? " [timeout]" : "");
@@ -227,9 +706,18 @@ inline score run_seed_ranges(level& l, field& f,
 					log_debug("Random test failed for seed: ", seed);
 				}
 			}
+			if (not params.checkpoint.empty()
+			    and std::chrono::steady_clock::now() - progress.last_save
+			            >= checkpoint_interval) {
+				save_checkpoint(std::string(params.checkpoint), seed_ranges,
+				                progress, params, worst, saved_hist);
+				progress.last_save = std::chrono::steady_clock::now();
+			}
 			if (not params.stats) {
-				// at least K passes and at least one fail
-				if (params.valid_count >= params.cheating_success_threshold
+				// more than K passes and at least one fail: the rest of the tests
+				// can't make the solution /h, so the flags don't depend on where
+				// the run stops
+				if (params.valid_count > params.cheating_success_threshold
 				    and params.valid_count < params.count) {
 					return;
 				}
@@ -239,21 +727,43 @@ inline score run_seed_ranges(level& l, field& f,
 			}
 		}
 	};
-	if (f.inputs().empty()) {
+	if (invariant) {
 		log_info("Secondary random tests skipped for invariant level");
 		range_t r{0, 1};
 		seed_range_iterator it2(std::span(&r, 1));
-		task(it_m, sc_m, it2, l, std::move(f), params, worst, counters[0]);
+		task(it_m, sc_m, it2, progress, std::span(&r, 1), l, std::move(f), params,
+		     worst, counters[0], perf_samples[0],
+		     histograms.empty() ? nullptr : &histograms[0], saved_hist, nullptr,
+		     std::nullopt);
 	} else if (num_threads > 1) {
-		std::vector<std::thread> threads;
-		for (auto i : range(num_threads)) {
-			threads.emplace_back(task, std::ref(it_m), std::ref(sc_m),
-			                     std::ref(seed_it), std::ref(l), f.clone(), params,
-			                     std::ref(worst), std::ref(counters[i]));
-		}
+		{
+			// cloned before starting any thread, as it can throw
+			std::vector<field> workers;
+			while (workers.size() != num_threads) {
+				workers.push_back(f.clone());
+			}
+			async_log log;
+			thread_error error;
+			std::vector<std::thread> threads;
+			for (auto i : range(num_threads)) {
+				threads.emplace_back(
+				    [&](auto&&... args) {
+					    error.run([&] {
+						    task(std::forward<decltype(args)>(args)...);
+					    });
+				    },
+				    std::ref(it_m), std::ref(sc_m), std::ref(seed_it),
+				    std::ref(progress), std::span(seed_ranges), std::ref(l),
+				    std::move(workers[i]), params, std::ref(worst),
+				    std::ref(counters[i]), std::ref(perf_samples[i]),
+				    histograms.empty() ? nullptr : &histograms[i], saved_hist,
+				    &error, i);
+			}
 
-		for (auto& t : threads) {
-			t.join();
+			for (auto& t : threads) {
+				t.join();
+			}
+			error.rethrow();
 		}
 		if (params.total_cycles >= params.total_cycles_limit) {
 			log_info("Total cycles timeout reached, stopping tests at ",
@@ -263,7 +773,35 @@ inline score run_seed_ranges(level& l, field& f,
 			log_info("Thread ", i, " ran ", x, " tests");
 		}
 	} else {
-		task(it_m, sc_m, seed_it, l, std::move(f), params, worst, counters[0]);
+		task(it_m, sc_m, seed_it, progress, seed_ranges, l, std::move(f), params,
+		     worst, counters[0], perf_samples[0],
+		     histograms.empty() ? nullptr : &histograms[0], saved_hist, nullptr,
+		     std::nullopt);
+	}
+	if (not checkpoint.empty()) {
+		save_checkpoint(checkpoint, seed_ranges, progress, params, worst,
+		                saved_hist);
+	}
+
+	if (params.perf) {
+		perf_sample total;
+		for (auto [s, i] : kblib::enumerate(perf_samples)) {
+			if (num_threads > 1) {
+				log_notice("Random tests thread ", i, ": ", to_string(s));
+			}
+			total += s;
+		}
+		// time is summed over threads, so this is the throughput per thread
+		log_notice("Random tests: ", to_string(total));
+	}
+	if (not histograms.empty()) {
+		for (auto& h : histograms | std::views::drop(1)) {
+			histograms[0] += h;
+		}
+		if (saved_hist) {
+			histograms[0] += *saved_hist;
+		}
+		log_notice("Random test cycles:\n", histograms[0].report());
 	}
 
 	if (stop_requested) {
@@ -274,4 +812,368 @@ inline score run_seed_ranges(level& l, field& f,
 }
 #pragma GCC diagnostic pop
 
+/// Split seed_ranges into shard_count contiguous parts of the same size (up to
+/// one seed), in the order the seeds would be tested
+/// @returns the ranges of part shard
+inline std::vector<range_t> shard_ranges(std::span<const range_t> seed_ranges,
+                                         std::uint32_t shard,
+                                         std::uint32_t shard_count) {
+	assert(shard < shard_count);
+	std::uint64_t total{};
+	for (auto r : seed_ranges) {
+		total += range_size(r);
+	}
+	auto start = [&](std::uint64_t i) {
+		return total / shard_count * i + std::min(i, total % shard_count);
+	};
+	auto begin = start(shard);
+	auto end = start(shard + 1);
+
+	std::vector<range_t> ret;
+	std::uint64_t offset{};
+	for (auto r : seed_ranges) {
+		auto b = std::max(begin, offset);
+		auto e = std::min(end, offset + range_size(r));
+		if (b < e) {
+			ret.push_back({static_cast<std::uint32_t>(r.begin + (b - offset)),
+			               static_cast<std::uint32_t>(r.begin + (e - offset))});
+		}
+		offset += range_size(r);
+	}
+	return ret;
+}
+
+/// Reorder seed_ranges so that the seeds of first that are in them come
+/// before all the others, in the order of first. The other seeds keep their
+/// order, and every seed is still tested as many times as before.
+inline std::vector<range_t> prioritize_seeds(std::span<const range_t> seed_ranges,
+                                             std::span<const std::uint32_t> first) {
+	std::vector<range_t> ret;
+	std::vector<range_t> rest;
+	for (auto r : seed_ranges) {
+		// offsets of the seeds moved to the front
+		std::vector<std::uint64_t> cuts;
+		for (auto seed : first) {
+			std::uint64_t offset = static_cast<std::uint32_t>(seed - r.begin);
+			if (offset < range_size(r) and std::ranges::find(cuts, offset) == cuts.end()) {
+				cuts.push_back(offset);
+				ret.push_back({seed, static_cast<std::uint32_t>(seed + 1)});
+			}
+		}
+		if (cuts.empty()) {
+			rest.push_back(r);
+			continue;
+		}
+		std::ranges::sort(cuts);
+		std::uint64_t prev{};
+		for (auto c : cuts) {
+			if (c > prev) {
+				rest.push_back({static_cast<std::uint32_t>(r.begin + prev),
+				                static_cast<std::uint32_t>(r.begin + c)});
+			}
+			prev = c + 1;
+		}
+		if (prev < range_size(r)) {
+			rest.push_back({static_cast<std::uint32_t>(r.begin + prev), r.end});
+		}
+	}
+	ret.insert(ret.end(), rest.begin(), rest.end());
+	return ret;
+}
+
+/// The outcome of one shard of a run, enough to merge shards into the result
+/// of a single run with all the seeds
+struct shard_result {
+	std::uint32_t shard{};
+	std::uint32_t shard_count{};
+	/// identifies the level, solution, seed ranges and settings, shards can
+	/// only be merged if it matches
+	std::uint64_t fingerprint{};
+	/// false if the run was stopped early
+	bool complete{};
+	/// the fixed tests were run
+	bool fixed_run{};
+	/// the score before the random tests
+	score fixed{};
+	std::size_t fixed_cycles{};
+	/// the random tests were run
+	bool random_run{};
+	uint count{};
+	uint valid_count{};
+	std::size_t random_cycles{};
+	score worst{};
+	double cheat_rate{};
+	/// up to max_recorded_failures, sorted
+	std::vector<std::uint32_t> failing_seeds;
+};
+
+constexpr std::string_view shard_result_header = "TIS-100-CXX shard result 1";
+
+/// @throws std::runtime_error if the file can't be written
+inline void write_shard_result(const std::string& path,
+                               const shard_result& r) {
+	std::ofstream out(path, std::ios::trunc);
+	out << shard_result_header << '\n'
+	    << "shard " << r.shard << '/' << r.shard_count << '\n'
+	    << "fingerprint " << r.fingerprint << '\n'
+	    << "complete " << r.complete << '\n'
+	    << "fixed " << r.fixed_run << ' ' << r.fixed.cycles << ' '
+	    << r.fixed.nodes << ' ' << r.fixed.instructions << ' '
+	    << r.fixed.validated << ' ' << r.fixed.achievement << ' '
+	    << r.fixed_cycles << '\n'
+	    << "random " << r.random_run << ' ' << r.count << ' ' << r.valid_count
+	    << ' ' << r.random_cycles << '\n'
+	    << "worst " << r.worst.cycles << ' ' << r.worst.nodes << ' '
+	    << r.worst.instructions << ' ' << r.worst.validated << '\n'
+	    << "cheat_rate " << std::setprecision(17) << r.cheat_rate << '\n'
+	    << "failing_seeds";
+	for (auto seed : r.failing_seeds) {
+		out << ' ' << seed;
+	}
+	out << '\n';
+	if (not out.flush()) {
+		throw std::runtime_error{
+		    concat("Cannot write shard result ", kblib::quoted(path))};
+	}
+}
+
+/// @throws std::runtime_error if the file can't be read or is invalid
+inline shard_result read_shard_result(const std::string& path) {
+	std::ifstream in(path);
+	if (not in) {
+		throw std::runtime_error{
+		    concat("Cannot open shard result ", kblib::quoted(path))};
+	}
+	auto invalid = [&](std::string_view what) {
+		return std::runtime_error{
+		    concat("Invalid shard result ", kblib::quoted(path), ": ", what)};
+	};
+	std::string line;
+	if (not std::getline(in, line) or line != shard_result_header) {
+		throw invalid("unknown format");
+	}
+	shard_result r;
+	auto expect = [&](std::string_view key) {
+		if (not std::getline(in, line) or not line.starts_with(key)) {
+			throw invalid(concat("expected ", key));
+		}
+		return std::istringstream(line.substr(key.size()));
+	};
+	char slash{};
+	expect("shard") >> r.shard >> slash >> r.shard_count;
+	if (slash != '/' or r.shard >= r.shard_count) {
+		throw invalid("bad shard number");
+	}
+	expect("fingerprint") >> r.fingerprint;
+	expect("complete") >> r.complete;
+	expect("fixed") >> r.fixed_run >> r.fixed.cycles >> r.fixed.nodes
+	    >> r.fixed.instructions >> r.fixed.validated >> r.fixed.achievement
+	    >> r.fixed_cycles;
+	expect("random") >> r.random_run >> r.count >> r.valid_count
+	    >> r.random_cycles;
+	expect("worst") >> r.worst.cycles >> r.worst.nodes >> r.worst.instructions
+	    >> r.worst.validated;
+	expect("cheat_rate") >> r.cheat_rate;
+	auto seeds = expect("failing_seeds");
+	std::uint32_t seed;
+	while (seeds >> seed) {
+		r.failing_seeds.push_back(seed);
+	}
+	return r;
+}
+
+/// Combine the results of all the shards of a run into the score a single
+/// run with stats would have reported, with count and valid_count summed
+/// @throws std::runtime_error if the shards don't form a complete run
+inline score merge_shard_results(std::span<const shard_result> shards,
+                                 uint& count, uint& valid_count) {
+	if (shards.empty()) {
+		throw std::runtime_error{"No shard results to merge"};
+	}
+	const auto& first = shards.front();
+	std::vector<bool> seen(first.shard_count);
+	for (const auto& r : shards) {
+		if (r.shard >= r.shard_count) {
+			throw std::runtime_error{
+			    concat("Invalid shard ", r.shard, '/', r.shard_count)};
+		} else if (r.fingerprint != first.fingerprint
+		           or r.shard_count != first.shard_count) {
+			throw std::runtime_error{
+			    concat("Shard ", r.shard, '/', r.shard_count,
+			           " belongs to a different run than shard ", first.shard,
+			           '/', first.shard_count)};
+		} else if (seen[r.shard]) {
+			throw std::runtime_error{
+			    concat("Shard ", r.shard, '/', r.shard_count, " given twice")};
+		} else if (not r.complete) {
+			throw std::runtime_error{concat("Shard ", r.shard, '/',
+			                                r.shard_count, " is incomplete")};
+		}
+		seen[r.shard] = true;
+	}
+	if (auto missing = std::ranges::find(seen, false); missing != seen.end()) {
+		throw std::runtime_error{concat("Shard ", missing - seen.begin(), '/',
+		                                first.shard_count, " is missing")};
+	}
+
+	score worst{};
+	std::size_t total_cycles = first.fixed_cycles;
+	count = 0;
+	valid_count = 0;
+	for (const auto& r : shards) {
+		count += r.count;
+		valid_count += r.valid_count;
+		total_cycles += r.random_cycles;
+		if (r.count != 0) {
+			worst.instructions = r.worst.instructions;
+			worst.nodes = r.worst.nodes;
+		}
+		worst.validated = worst.validated or r.worst.validated;
+		worst.cycles = std::max(worst.cycles, r.worst.cycles);
+	}
+
+	// same as the end of the random tests in main
+	score sc = first.fixed;
+	if (first.random_run) {
+		if (not first.fixed_run) {
+			sc = worst;
+			if (not sc.validated) {
+				sc.cycles = total_cycles;
+			}
+		}
+		sc.cheat = (count == 0 or count != valid_count);
+		sc.hardcoded
+		    = (valid_count <= static_cast<uint>(count * first.cheat_rate));
+	}
+	return sc;
+}
+
+struct seed_failure {
+	std::uint32_t seed;
+	std::size_t cycles;
+	bool timeout;
+};
+
+/// Search for random tests the solution fails, in seed_ranges or in the whole
+/// seed space if empty, on num_threads threads, stopping as soon as
+/// max_failures are found. Seeds are handed out in blocks through an atomic
+/// counter, so the threads never wait on each other.
+/// @returns the failures found, sorted by seed
+inline std::vector<seed_failure>
+hunt_failing_seeds(level& l, const field& f, std::vector<range_t> seed_ranges,
+                   std::size_t cycles_limit, std::size_t max_failures,
+                   unsigned num_threads) {
+	using namespace std::chrono_literals;
+	if (f.inputs().empty()) {
+		log_info("Seed hunt skipped for invariant level");
+		return {};
+	}
+	constexpr std::uint64_t block_size = 256;
+	if (seed_ranges.empty()) {
+		seed_ranges.push_back({0, 0});
+	}
+	// offsets of each range in the flattened sequence of seeds
+	std::vector<std::uint64_t> offsets{0};
+	for (auto r : seed_ranges) {
+		offsets.push_back(offsets.back() + range_size(r));
+	}
+	auto seed_at = [&](std::uint64_t i) -> std::uint32_t {
+		auto r = std::ranges::upper_bound(offsets, i) - offsets.begin() - 1;
+		return static_cast<std::uint32_t>(seed_ranges[to_unsigned(r)].begin
+		                                  + (i - offsets[to_unsigned(r)]));
+	};
+	const auto total = offsets.back();
+
+	std::atomic<std::uint64_t> next_index;
+	std::atomic<std::uint64_t> tested;
+	std::atomic<unsigned> running{num_threads};
+	std::mutex failures_m;
+	std::vector<seed_failure> failures;
+	std::atomic<std::size_t> failure_count;
+
+	thread_error error;
+	auto hunt = [&](field worker, unsigned id) {
+		log_thread_scope log_scope(id);
+		error.run([&] {
+			while (failure_count < max_failures and not stop_requested
+			       and not error.cancelled()) {
+				auto begin = next_index.fetch_add(block_size);
+				if (begin >= total) {
+					break;
+				}
+				auto end = std::min(begin + block_size, total);
+				auto i = begin;
+				for (; i != end; ++i) {
+					// the other threads may have found the last failures, or
+					// thrown
+					if (failure_count >= max_failures or error.cancelled()) {
+						break;
+					}
+					auto seed = seed_at(i);
+					set_log_seed(seed);
+					auto test = l.random_test(seed);
+					if (not test) {
+						continue;
+					}
+					set_expected(worker, *test);
+					auto sc = run(worker, cycles_limit, false);
+					if (stop_requested) {
+						break;
+					}
+					if (not sc.validated) {
+						std::unique_lock lock(failures_m);
+						if (failures.size() < max_failures) {
+							log_info("Failing seed found: ", seed);
+							failures.push_back(
+							    {seed, sc.cycles, sc.cycles == cycles_limit});
+							++failure_count;
+						}
+					}
+				}
+				tested += i - begin;
+			}
+		});
+		--running;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		// cloned before starting any thread, as it can throw
+		std::vector<field> workers;
+		while (workers.size() != num_threads) {
+			workers.push_back(f.clone());
+		}
+		async_log log;
+		std::vector<std::jthread> threads;
+		for (auto i : range(num_threads)) {
+			threads.emplace_back(hunt, std::move(workers[i]), i);
+		}
+		auto last_report = start;
+		while (running != 0) {
+			std::this_thread::sleep_for(100ms);
+			auto now = std::chrono::steady_clock::now();
+			if (now - last_report >= 10s) {
+				last_report = now;
+				auto seconds = std::chrono::duration<double>(now - start).count();
+				log_notice("Seed hunt: ", tested.load(), "/", total,
+				           " seeds tested (",
+				           static_cast<double>(tested) / seconds,
+				           " seeds/s), ", failure_count.load(), " failures");
+			}
+		}
+	}
+	error.rethrow();
+	log_info("Seed hunt tested ", std::min(tested.load(), total), " seeds in ",
+	         std::chrono::duration<double>(std::chrono::steady_clock::now()
+	                                       - start)
+	             .count(),
+	         " s");
+	if (stop_requested) {
+		log_warn("Stop requested");
+	}
+
+	std::ranges::sort(failures, {}, &seed_failure::seed);
+	return failures;
+}
+
 #endif // RUNNER_HPP
@@ -0,0 +1,131 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "seed_catalogue.hpp"
+#include "levels.hpp"
+#include "logger.hpp"
+#include "parser.hpp"
+
+#include <kblib/stringops.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <ranges>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+constexpr std::string_view seed_catalogue_header = "TIS-100-CXX seed catalogue 1";
+
+seed_catalogue read_seed_catalogue(const std::string& path) {
+	std::ifstream in(path);
+	if (not in) {
+		throw std::runtime_error{
+		    concat("Cannot open seed catalogue ", kblib::quoted(path))};
+	}
+	auto invalid = [&](std::string_view what) {
+		return std::runtime_error{
+		    concat("Invalid seed catalogue ", kblib::quoted(path), ": ", what)};
+	};
+	std::string line;
+	if (not std::getline(in, line) or line != seed_catalogue_header) {
+		throw invalid("unknown format");
+	}
+	seed_catalogue c;
+	while (std::getline(in, line)) {
+		std::istringstream is(line);
+		std::string segment;
+		if (not (is >> segment)) {
+			continue;
+		}
+		auto& seeds = c.levels[segment];
+		std::uint32_t seed;
+		while (is >> seed) {
+			seeds.push_back(seed);
+		}
+		if (not is.eof()) {
+			throw invalid(concat("bad seed for level ", segment));
+		}
+	}
+	return c;
+}
+
+void write_seed_catalogue(const std::string& path, const seed_catalogue& c) {
+	std::ofstream out(path, std::ios::trunc);
+	out << seed_catalogue_header << '\n';
+	for (const auto& [segment, seeds] : c.levels) {
+		out << segment;
+		for (auto seed : seeds) {
+			out << ' ' << seed;
+		}
+		out << '\n';
+	}
+	if (not out.flush()) {
+		throw std::runtime_error{
+		    concat("Cannot write seed catalogue ", kblib::quoted(path))};
+	}
+}
+
+std::optional<std::size_t> catalogue_builder::add(uint level_id,
+                                                  const std::string& code,
+                                                  uint T21_size,
+                                                  uint T30_size) {
+	builtin_level l(level_id);
+	field f = l.new_field(T30_size);
+	parse_code(f, code, T21_size);
+
+	// same timeout as the random tests of the validator
+	std::size_t cycles{};
+	for (const auto& test : l.static_suite()) {
+		set_expected(f, test);
+		auto sc = run(f, cycles_limit, false);
+		if (not sc.validated) {
+			return std::nullopt;
+		}
+		cycles = std::max(cycles, sc.cycles);
+	}
+	auto random_limit = std::min(
+	    cycles_limit,
+	    static_cast<std::size_t>(static_cast<double>(cycles) * limit_multiplier));
+
+	auto seeds = hunt_failing_seeds(l, f, seed_ranges, random_limit,
+	                                std::numeric_limits<std::size_t>::max(),
+	                                num_threads);
+	auto& counts = failures[std::string(builtin_layouts[level_id].segment)];
+	for (auto s : seeds) {
+		++counts[s.seed];
+	}
+	return seeds.size();
+}
+
+seed_catalogue catalogue_builder::build(std::size_t size) const {
+	seed_catalogue c;
+	for (const auto& [segment, counts] : failures) {
+		std::vector<std::pair<std::uint32_t, std::size_t>> ranked(counts.begin(),
+		                                                          counts.end());
+		// stable, so that ties keep the order of the seeds
+		std::ranges::stable_sort(ranked, std::greater{},
+		                         &std::pair<std::uint32_t, std::size_t>::second);
+		auto& seeds = c.levels[segment];
+		for (auto [seed, n] : ranked | std::views::take(size)) {
+			seeds.push_back(seed);
+		}
+	}
+	return c;
+}
@@ -0,0 +1,89 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef SEED_CATALOGUE_HPP
+#define SEED_CATALOGUE_HPP
+
+#include "runner.hpp"
+#include "utils.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// For each builtin level, by segment, the random seeds that most often make
+/// cheating solutions fail, the most discriminating first
+struct seed_catalogue {
+	std::map<std::string, std::vector<std::uint32_t>, std::less<>> levels;
+
+	/// @returns the seeds of a level, empty if it's not in the catalogue
+	std::span<const std::uint32_t> seeds(std::string_view segment) const {
+		auto it = levels.find(segment);
+		if (it == levels.end()) {
+			return {};
+		}
+		return it->second;
+	}
+};
+
+/// @throws std::runtime_error if the file can't be read or is invalid
+seed_catalogue read_seed_catalogue(const std::string& path);
+
+/// @throws std::runtime_error if the file can't be written
+void write_seed_catalogue(const std::string& path, const seed_catalogue& c);
+
+/// Counts the seeds that each known cheating solution fails, to build a
+/// catalogue from a corpus of them
+class catalogue_builder {
+ public:
+	/// The seeds in seed_ranges are tried with the random test timeout of the
+	/// validator: cycles_limit, or limit_multiplier times the cycles of the
+	/// fixed tests if lower
+	catalogue_builder(std::vector<range_t> seed_ranges, std::size_t cycles_limit,
+	                  double limit_multiplier, unsigned num_threads)
+	    : seed_ranges(std::move(seed_ranges))
+	    , cycles_limit(cycles_limit)
+	    , limit_multiplier(limit_multiplier)
+	    , num_threads(num_threads) {}
+
+	/// Run a solution of a builtin level on every seed
+	/// @returns the number of seeds it fails, or nullopt if it doesn't pass
+	/// the fixed tests, in which case it's not counted
+	/// @throws std::invalid_argument if the code doesn't assemble
+	std::optional<std::size_t> add(uint level_id, const std::string& code,
+	                               uint T21_size, uint T30_size);
+
+	/// The seeds failed by the most solutions of each level, at most size per
+	/// level, ties broken by the lowest seed
+	seed_catalogue build(std::size_t size) const;
+
+ private:
+	std::vector<range_t> seed_ranges;
+	std::size_t cycles_limit;
+	double limit_multiplier;
+	unsigned num_threads;
+	/// number of solutions failing each seed, by level segment
+	std::map<std::string, std::map<std::uint32_t, std::size_t>, std::less<>>
+	    failures;
+};
+
+#endif // SEED_CATALOGUE_HPP
@@ -0,0 +1,184 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef SPEC_CACHE_HPP
+#define SPEC_CACHE_HPP
+
+#include "builtin_specs.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+
+#include <kblib/hash.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iomanip>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+/// A custom spec compiled to Lua bytecode, with the layout its functions
+/// returned, so loading it needs neither the parser nor the layout functions
+struct spec_cache_entry {
+	dynamic_layout_spec layout;
+	std::string bytecode;
+};
+
+constexpr std::string_view spec_cache_header = "TIS-100-CXX spec cache 2";
+/// entries are far smaller, a larger file is damaged
+constexpr std::uintmax_t max_spec_cache_size = 64 << 20;
+
+/// The entry of a spec with this source in dir. Bytecode is only valid for
+/// the Lua version that wrote it, so it's part of the key.
+inline std::filesystem::path spec_cache_path(const std::filesystem::path& dir,
+                                             std::string_view source,
+                                             std::string_view lua_version) {
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0')
+	     << kblib::FNV64a(lua_version, kblib::FNV64a(source)) << ".tiscache";
+	return dir / name.str();
+}
+
+/// @returns nullopt if there is no valid entry at path, a damaged one is
+/// reported and then rebuilt by the caller. The layout and bytecode are
+/// checked against their hash, as LuaJIT doesn't verify bytecode.
+inline std::optional<spec_cache_entry>
+read_spec_cache(const std::filesystem::path& path, std::string_view lua_version) {
+	std::ifstream file(path, std::ios::binary);
+	if (not file) {
+		return std::nullopt;
+	}
+	auto invalid = [&](std::string_view what) {
+		log_warn("Ignoring spec cache ", path.string(), ": ", what);
+		return std::nullopt;
+	};
+	std::error_code ec;
+	if (auto size = std::filesystem::file_size(path, ec);
+	    ec or size > max_spec_cache_size) {
+		return invalid("too large");
+	}
+	std::string line;
+	if (not std::getline(file, line) or line != spec_cache_header) {
+		return invalid("unknown format");
+	}
+	if (not std::getline(file, line) or line != concat("lua ", lua_version)) {
+		return invalid("different Lua version");
+	}
+	std::uint64_t hash{};
+	if (not std::getline(file, line) or not line.starts_with("hash ")
+	    or not (std::istringstream(line.substr(5)) >> std::hex >> hash)) {
+		return invalid("expected hash");
+	}
+	std::ostringstream body;
+	body << file.rdbuf();
+	auto contents = std::move(body).str();
+	if (kblib::FNV64a(contents) != hash) {
+		return invalid("damaged");
+	}
+	std::istringstream in(std::move(contents));
+
+	spec_cache_entry e;
+	std::size_t width{};
+	std::size_t height{};
+	bool types_valid = true;
+	auto read_types = [&](std::vector<node::type_t>& v,
+	                      std::initializer_list<node::type_t> allowed) {
+		for (auto& t : v) {
+			int i{};
+			in >> i;
+			t = static_cast<node::type_t>(i);
+			types_valid = types_valid
+			              and std::ranges::find(allowed, t) != allowed.end();
+		}
+	};
+	if (not (in >> line >> height >> width) or line != "layout"
+	    or (width != 0 and height > max_spec_cache_size / width)) {
+		return invalid("expected layout");
+	}
+	e.layout.nodes.assign(height, std::vector<node::type_t>(width));
+	for (auto& row : e.layout.nodes) {
+		read_types(row, {node::T21, node::T30, node::Damaged});
+	}
+	e.layout.inputs.resize(width);
+	e.layout.outputs.resize(width);
+	read_types(e.layout.inputs, {node::in, node::null});
+	read_types(e.layout.outputs, {node::out, node::image, node::null});
+	if (not in or not types_valid) {
+		return invalid("invalid node types");
+	}
+
+	std::size_t size{};
+	if (not (in >> line >> size) or line != "bytecode" or in.get() != '\n'
+	    or size > max_spec_cache_size) {
+		return invalid("expected bytecode");
+	}
+	e.bytecode.resize(size);
+	if (not in.read(e.bytecode.data(), static_cast<std::streamsize>(size))) {
+		return invalid("truncated bytecode");
+	}
+	return e;
+}
+
+/// Written to a temporary file and renamed over path, so that concurrent runs
+/// never read a partial entry. Failing to write it only loses the caching.
+inline void write_spec_cache(const std::filesystem::path& path,
+                             const spec_cache_entry& e,
+                             std::string_view lua_version) {
+	std::ostringstream body;
+	body << "layout " << e.layout.nodes.size() << ' ' << e.layout.inputs.size()
+	     << '\n';
+	auto write_types = [&](const std::vector<node::type_t>& v) {
+		for (auto t : v) {
+			body << static_cast<int>(t) << ' ';
+		}
+		body << '\n';
+	};
+	for (const auto& row : e.layout.nodes) {
+		write_types(row);
+	}
+	write_types(e.layout.inputs);
+	write_types(e.layout.outputs);
+	body << "bytecode " << e.bytecode.size() << '\n' << e.bytecode;
+	auto contents = std::move(body).str();
+
+	auto tmp = path;
+	tmp += concat(".tmp", std::random_device{}());
+	{
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		out << spec_cache_header << "\nlua " << lua_version << "\nhash "
+		    << std::hex << kblib::FNV64a(contents) << '\n'
+		    << contents;
+		if (not out) {
+			log_warn("Could not write spec cache ", tmp.string());
+			return;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, path, ec);
+	if (ec) {
+		log_warn("Could not write spec cache ", path.string(), ": ",
+		         ec.message());
+		std::filesystem::remove(tmp, ec);
+	}
+}
+
+#endif // SPEC_CACHE_HPP
@@ -0,0 +1,34 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "levels.hpp"
+#include "image.hpp"
+#include "parser.hpp"
+
+#include <array>
+#include <vector>
+
+const std::array<single_test, 3>& builtin_level::static_suite() {
+	// written at build time by gen_static_suites from random_test, so that no
+	// solution has to generate them again
+	static const std::array<std::array<single_test, 3>, builtin_levels_num>
+	    suites{{
+#include "static_suites.inc"
+	    }};
+	return suites[level_id];
+}
@@ -0,0 +1,189 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "tar.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr std::size_t block_size = 512;
+/// Saves are a few KB, larger members are skipped without reading them
+constexpr std::uint64_t max_member_size = 16 << 20;
+using block = std::array<char, block_size>;
+
+/// A NUL-terminated header field
+std::string_view field_str(const block& b, std::size_t offset,
+                           std::size_t size) {
+	std::string_view f(b.data() + offset, size);
+	return f.substr(0, f.find('\0'));
+}
+
+/// A numeric header field, in octal, or in base-256 if the high bit of the
+/// first byte is set (a GNU extension for large sizes)
+std::uint64_t field_num(const block& b, std::size_t offset, std::size_t size) {
+	std::uint64_t n{};
+	if (static_cast<unsigned char>(b[offset]) & 0x80) {
+		for (auto i : range(offset + 1, offset + size)) {
+			if (n >> 56 != 0) {
+				throw std::runtime_error{"Number too large in tar header"};
+			}
+			n = n << 8 | static_cast<unsigned char>(b[i]);
+		}
+		return n;
+	}
+	for (auto c : std::string_view(b.data() + offset, size)) {
+		if (c >= '0' and c <= '7') {
+			n = n * 8 + to_unsigned(c - '0');
+		} else if (c != ' ' and c != '\0') {
+			throw std::runtime_error{"Invalid number in tar header"};
+		}
+	}
+	return n;
+}
+
+/// The checksum is the sum of the header bytes, counting its own field as
+/// spaces
+bool valid_checksum(const block& b) {
+	auto sum = std::accumulate(b.begin(), b.end(), std::uint64_t{},
+	                           [](std::uint64_t s, char c) {
+		                           return s + static_cast<unsigned char>(c);
+	                           });
+	for (auto i : range(std::size_t{148}, std::size_t{156})) {
+		sum = sum - static_cast<unsigned char>(b[i]) + ' ';
+	}
+	return sum == field_num(b, 148, 8);
+}
+
+/// Skip n bytes of in
+/// @throws std::runtime_error if it ends before them
+void skip(std::istream& in, std::uint64_t n) {
+	constexpr std::uint64_t chunk = std::uint64_t{1} << 30;
+	while (n != 0) {
+		auto step = static_cast<std::streamsize>(std::min(n, chunk));
+		if (in.ignore(step).gcount() != step) {
+			throw std::runtime_error{"Truncated tar archive"};
+		}
+		n -= static_cast<std::uint64_t>(step);
+	}
+}
+
+/// The path of a pax extended header, made of "<length> <key>=<value>\n"
+/// records
+std::optional<std::string> pax_path(std::string_view records) {
+	while (not records.empty()) {
+		auto space = records.find(' ');
+		if (space == std::string_view::npos) {
+			break;
+		}
+		std::size_t length{};
+		for (auto c : records.substr(0, space)) {
+			length = length * 10 + to_unsigned(c - '0');
+		}
+		if (length <= space or length > records.size()) {
+			throw std::runtime_error{"Invalid pax header in tar archive"};
+		}
+		auto record = records.substr(space + 1, length - space - 2);
+		if (record.starts_with("path=")) {
+			return std::string(record.substr(5));
+		}
+		records.remove_prefix(length);
+	}
+	return std::nullopt;
+}
+
+} // namespace
+
+std::vector<tar_member> read_tar(std::istream& in) {
+	std::vector<tar_member> ret;
+	// from a GNU long name or pax header, for the next member
+	std::optional<std::string> next_path;
+	block b;
+	while (in.read(b.data(), block_size)) {
+		if (std::ranges::all_of(b, [](char c) { return c == '\0'; })) {
+			// end of archive
+			return ret;
+		}
+		if (not valid_checksum(b)) {
+			throw std::runtime_error{"Invalid tar header checksum"};
+		}
+		auto size = field_num(b, 124, 12);
+		auto padding = (block_size - size % block_size) % block_size;
+		char type = b[156];
+		if (size > max_member_size) {
+			if (type == 'L' or type == 'x') {
+				throw std::runtime_error{"Invalid tar header size"};
+			}
+			log_warn("Skipping tar member ", field_str(b, 0, 100), " of ",
+			         size, " bytes");
+			next_path.reset();
+			skip(in, size);
+			skip(in, padding);
+			continue;
+		}
+		std::string contents(size, '\0');
+		if (not in.read(contents.data(), static_cast<std::streamsize>(size))) {
+			throw std::runtime_error{"Truncated tar archive"};
+		}
+		in.ignore(static_cast<std::streamsize>(padding));
+
+		switch (type) {
+		case 'L':
+			next_path = contents.substr(0, contents.find('\0'));
+			break;
+		case 'x':
+			if (auto p = pax_path(contents)) {
+				next_path = std::move(p);
+			}
+			break;
+		case '0':
+		case '\0':
+		case '7': {
+			tar_member m{std::string(field_str(b, 0, 100)), std::move(contents)};
+			if (next_path) {
+				m.path = *std::exchange(next_path, std::nullopt);
+			} else if (field_str(b, 257, 5) == "ustar") {
+				if (auto prefix = field_str(b, 345, 155); not prefix.empty()) {
+					m.path = concat(prefix, '/', m.path);
+				}
+			}
+			ret.push_back(std::move(m));
+		} break;
+		default:
+			// directories, links and global headers
+			log_debug("Skipping tar member ", field_str(b, 0, 100), " of type ",
+			          type);
+			next_path.reset();
+			break;
+		}
+	}
+	if (in.gcount() != 0) {
+		throw std::runtime_error{"Truncated tar archive"};
+	}
+	// some writers omit the end of archive blocks
+	return ret;
+}
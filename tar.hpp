@@ -0,0 +1,37 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef TAR_HPP
+#define TAR_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// A regular file of a tar archive
+struct tar_member {
+	std::string path;
+	std::string contents;
+};
+
+/// Read the regular files of an uncompressed tar archive, in the ustar, GNU
+/// or pax formats, in the order they're stored. Other members (directories,
+/// links) are skipped.
+/// @throws std::runtime_error if the archive is truncated or damaged
+std::vector<tar_member> read_tar(std::istream& in);
+
+#endif // TAR_HPP
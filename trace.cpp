@@ -0,0 +1,212 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "trace.hpp"
+#include "T21.hpp"
+
+#include <kblib/stringops.h>
+
+#include <array>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+
+// the version is part of the magic, the event size is checked separately
+constexpr std::string_view trace_magic = "TIStrc01";
+
+trace_writer::trace_writer(const std::string& path)
+    : out(path, std::ios::binary | std::ios::trunc) {
+	if (not out) {
+		throw std::runtime_error{
+		    concat("Cannot open trace file ", kblib::quoted(path))};
+	}
+	std::uint32_t size = sizeof(trace_event);
+	out.write(trace_magic.data(), trace_magic.size());
+	out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	buffer.reserve(1 << 16);
+}
+
+void trace_writer::flush() {
+	out.write(reinterpret_cast<const char*>(buffer.data()),
+	          static_cast<std::streamsize>(buffer.size() * sizeof(trace_event)));
+	out.flush();
+	buffer.clear();
+}
+
+// Mirrors the debug output of T21::step
+static void render_step(const trace_event& e, std::string& ret) {
+	append(ret, "step(", e.x, ',', e.y, ',', e.pc, "): instruction type: ");
+	if (e.s == activity::write) {
+		ret += "MOV stalled[W]\n";
+		return;
+	}
+	auto op = static_cast<instr::op>(e.op);
+	ret += to_string(op);
+	if (e.r == word_empty) {
+		ret += " stalled[R]\n";
+		return;
+	}
+	auto branch = [&](bool taken) {
+		append(ret, " (", taken ? "taken" : "not taken", ") ", e.val);
+	};
+	switch (op) {
+	case instr::hcf:
+		append(ret, "\n\ts = ", state_name(activity::run));
+		// the step is cut short by the exception
+		return;
+	case instr::nop:
+		break;
+	case instr::swp:
+		append(ret, " (", e.acc, "<->", e.bak, ')');
+		break;
+	case instr::sav:
+		append(ret, " (", e.acc, "->", e.bak, ')');
+		break;
+	case instr::neg:
+		append(ret, " (", e.acc, ')');
+		break;
+	case instr::mov:
+		append(ret, " (", e.r, ") ");
+		if (e.dst == port::acc) {
+			append(ret, "acc = ", e.r);
+		} else if (e.dst == port::last and e.last == port::nil) {
+			append(ret, "last[N/A] = ", e.r);
+		} else if (e.dst != port::nil) {
+			ret += "stalling[W]";
+		}
+		break;
+	case instr::add:
+	case instr::sub:
+		append(ret, " (", e.acc, ") ", e.r);
+		break;
+	case instr::jmp:
+		append(ret, " ", e.val);
+		break;
+	case instr::jez:
+		branch(e.acc == 0);
+		break;
+	case instr::jnz:
+		branch(e.acc != 0);
+		break;
+	case instr::jgz:
+		branch(e.acc > 0);
+		break;
+	case instr::jlz:
+		branch(e.acc < 0);
+		break;
+	case instr::jro:
+		append(ret, " (", e.pc, '+', e.r, " -> ",
+		       sat_add(e.pc, e.r, word_t{}, to_word(e.size - 1)), ")");
+		break;
+	default:
+		throw std::runtime_error{
+		    concat("Invalid opcode ", etoi(op), " in trace at cycle ", e.cycle)};
+	}
+	ret += '\n';
+}
+
+// Mirrors the debug output of T21::finalize
+static void render_finalize(const trace_event& e, std::string& ret) {
+	append(ret, "finalize(", e.x, ',', e.y, ',', e.pc, "): ");
+	if (e.s != activity::write) {
+		ret += "skipped";
+	} else if (e.r == word_empty) {
+		ret += "mov completed";
+	} else if (e.dst == port::nil) {
+		ret += "mov started";
+	} else {
+		ret += "mov in progress";
+	}
+	ret += '\n';
+}
+
+void decode_trace(const std::string& path, std::ostream& os) {
+	std::ifstream in(path, std::ios::binary);
+	if (not in) {
+		throw std::runtime_error{
+		    concat("Cannot open trace file ", kblib::quoted(path))};
+	}
+	std::array<char, trace_magic.size()> magic{};
+	std::uint32_t size{};
+	in.read(magic.data(), magic.size());
+	in.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (not in or std::string_view(magic.data(), magic.size()) != trace_magic) {
+		throw std::runtime_error{
+		    concat(kblib::quoted(path), " is not a TIS-100-CXX trace")};
+	} else if (size != sizeof(trace_event)) {
+		throw std::runtime_error{concat("Trace event size ", size,
+		                                " does not match this build (",
+		                                sizeof(trace_event), ")")};
+	}
+
+	// text of the current field step, logged as a single message
+	std::string block;
+	bool in_block{};
+	auto end_block = [&] {
+		if (std::exchange(in_block, false)) {
+			os << "DEBUG: " << block << '\n';
+			block.clear();
+		}
+	};
+
+	std::vector<trace_event> events(1 << 16);
+	while (in) {
+		in.read(reinterpret_cast<char*>(events.data()),
+		        static_cast<std::streamsize>(events.size() * sizeof(trace_event)));
+		auto n = static_cast<std::size_t>(in.gcount()) / sizeof(trace_event);
+		for (const auto& e : std::span(events.data(), n)) {
+			switch (e.kind) {
+			case trace_event::field_step:
+				end_block();
+				in_block = true;
+				block += "Field step\n";
+				break;
+			case trace_event::phase:
+				block += '\n';
+				break;
+			case trace_event::step:
+				render_step(e, block);
+				break;
+			case trace_event::finalize:
+				render_finalize(e, block);
+				break;
+			case trace_event::input:
+				append(block, 'I', e.x, ": ");
+				if (e.dst == port::nil) {
+					block += "writing";
+				} else if (e.r == word_empty and e.flag) {
+					block += "reloading";
+				} else {
+					block += "waiting";
+				}
+				block += '\n';
+				break;
+			case trace_event::output:
+				append(block, 'O', e.x, ": read\n");
+				if (e.flag) {
+					block += "incorrect value written\n";
+				}
+				break;
+			default:
+				throw std::runtime_error{concat("Invalid event kind ",
+				                                etoi(e.kind), " in trace")};
+			}
+		}
+	}
+	end_block();
+}
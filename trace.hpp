@@ -0,0 +1,113 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "node.hpp"
+#include "utils.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// A fixed size record of one event of the simulation kernels, holding enough
+/// state to render the same text as the debug log
+struct trace_event {
+	enum kind_t : std::uint8_t {
+		/// start of a field step
+		field_step,
+		/// boundary between the step, IO and finalize phases of a field step
+		phase,
+		/// T21::step, with the registers before executing the instruction and
+		/// r the value read
+		step,
+		/// T21::finalize, with the registers before completing the write, r the
+		/// pending word and dst the write port
+		finalize,
+		/// input_node::finalize, with the pending word and write port, flag is
+		/// set if there are values left to emit
+		input,
+		/// num_output::step reading r, flag is set if r was incorrect
+		output,
+	};
+
+	std::uint32_t cycle{};
+	std::int16_t x{};
+	std::int16_t y{};
+	kind_t kind{};
+	/// instr::op of the current instruction
+	std::int8_t op{};
+	activity s{};
+	port dst{port::nil};
+	port last{port::nil};
+	bool flag{};
+	word_t pc{};
+	word_t acc{};
+	word_t bak{};
+	word_t r{word_empty};
+	/// jump target or immediate of the current instruction
+	word_t val{};
+	/// code length
+	word_t size{};
+};
+static_assert(std::is_trivially_copyable_v<trace_event>);
+
+/// Debug sinks that accept trace_events instead of (or in addition to) text
+template <typename Log>
+concept event_sink = requires(Log& l, const trace_event& e) { l.record(e); };
+
+/// Debug sink for the simulation kernels that writes trace_events to a binary
+/// file, buffered. Text is discarded.
+class trace_writer {
+ public:
+	/// @throws std::runtime_error if the file can't be opened
+	explicit trace_writer(const std::string& path);
+	~trace_writer() { flush(); }
+	trace_writer(const trace_writer&) = delete;
+	trace_writer& operator=(const trace_writer&) = delete;
+
+	[[gnu::always_inline]] inline void record(trace_event e) {
+		e.cycle = cycle;
+		buffer.push_back(e);
+		if (buffer.size() == buffer.capacity()) [[unlikely]] {
+			flush();
+		}
+	}
+
+	auto operator<<(const auto&) -> trace_writer& { return *this; }
+	auto log_r(auto&&) -> void {}
+
+	void flush();
+
+	/// the cycle stamped on the recorded events, set by the runner
+	std::uint32_t cycle{};
+
+ private:
+	std::ofstream out;
+	std::vector<trace_event> buffer;
+};
+
+/// Render a trace written by trace_writer, in the format of the debug log of
+/// the field steps
+/// @throws std::runtime_error if the file is not a valid trace
+void decode_trace(const std::string& path, std::ostream& os);
+
+#endif // TRACE_HPP
@@ -23,6 +23,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <type_traits>
 #include <vector>
 
@@ -53,6 +54,8 @@ static_assert(word_empty < word_min);
 static_assert(word_empty < word_min + word_min);
 
 using word_vec = std::vector<word_t>;
+/// Non-owning view of test data
+using word_view = std::span<const word_t>;
 constexpr word_t to_word(auto x) { return static_cast<word_t>(x); }
 
 template <typename T, typename U>
@@ -183,8 +186,8 @@ template <typename Stream>
 	   { s << "" << 1 };
 	   { s.good() } -> std::same_as<bool>;
    }
-inline Stream&& write_list(Stream&& os, const word_vec& v,
-                           const word_vec* expected = nullptr,
+inline Stream&& write_list(Stream&& os, word_view v,
+                           const word_view* expected = nullptr,
                            bool colored = color_logs) {
 	if (not os.good()) { // this method is costly, immediately bail out
 		return std::forward<Stream>(os);
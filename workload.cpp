@@ -0,0 +1,166 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+
+#include "workload.hpp"
+#include "utils.hpp"
+
+#include <kblib/stringops.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+
+workload make_workload(const workload_params& params) {
+	if (params.width == 0 or params.height == 0) {
+		throw std::invalid_argument{"Workload size must not be zero"};
+	}
+	for (double f : {params.traffic, params.t30, params.stalled, params.alu}) {
+		if (f < 0 or f > 1) {
+			throw std::invalid_argument{
+			    "Workload fractions must be in the range 0-1"};
+		}
+	}
+	const auto width = params.width;
+	const auto height = params.height;
+	std::mt19937_64 rng(params.seed);
+	auto chance = [&](double p) { return std::bernoulli_distribution(p)(rng); };
+
+	workload ret;
+	auto& layout = ret.layout;
+	// at least one stream, so the level has something to validate
+	std::vector<bool> is_stream(width);
+	std::vector<std::size_t> columns(width);
+	std::ranges::generate(columns, [i = std::size_t{}]() mutable { return i++; });
+	std::ranges::shuffle(columns, rng);
+	auto stream_count = std::max<std::size_t>(
+	    1, static_cast<std::size_t>(params.traffic * static_cast<double>(width)));
+	for (auto x : columns | std::views::take(stream_count)) {
+		is_stream[x] = true;
+	}
+	for (auto x : range(width)) {
+		if (is_stream[x]) {
+			ret.streams.push_back(x);
+		}
+	}
+
+	layout.nodes.assign(height, std::vector<node::type_t>(width, node::T21));
+	layout.inputs.assign(width, node::null);
+	layout.outputs.assign(width, node::null);
+	for (auto x : ret.streams) {
+		layout.inputs[x] = node::in;
+		layout.outputs[x] = node::out;
+	}
+	for (auto y : range(height)) {
+		for (auto x : range(width)) {
+			if (not is_stream[x] and chance(params.t30)) {
+				layout.nodes[y][x] = node::T30;
+			}
+		}
+	}
+	auto is_t30 = [&](std::ptrdiff_t x, std::ptrdiff_t y) {
+		return x >= 0 and y >= 0 and std::cmp_less(x, width)
+		       and std::cmp_less(y, height)
+		       and layout.nodes[to_unsigned(y)][to_unsigned(x)] == node::T30;
+	};
+
+	// T21 sources in the order of the @N labels
+	std::size_t label{};
+	for (auto y : range(height)) {
+		for (auto x : range(width)) {
+			if (layout.nodes[y][x] != node::T21) {
+				continue;
+			}
+			auto sx = static_cast<std::ptrdiff_t>(x);
+			auto sy = static_cast<std::ptrdiff_t>(y);
+			append(ret.solution, '@', label++, '\n');
+			std::string code;
+			if (is_stream[x]) {
+				// a T30 on the right holds one value at a time, the nodes
+				// around it never read from it, but T30s take the values of
+				// their T30 neighbors
+				std::string_view src = "UP";
+				if (is_t30(sx + 1, sy) and not is_t30(sx + 2, sy)
+				    and not is_t30(sx + 1, sy - 1) and not is_t30(sx + 1, sy + 1)) {
+					code += "MOV UP, RIGHT\n";
+					src = "RIGHT";
+				}
+				if (chance(params.alu)) {
+					// the value is restored from BAK, so saturation doesn't matter
+					append(code, "MOV ", src,
+					       ", ACC\nSAV\nADD 7\nNEG\nSUB 7\nSWP\nMOV ACC, DOWN\n");
+				} else {
+					append(code, "MOV ", src, ", DOWN\n");
+				}
+			} else if (chance(params.stalled)) {
+				// no node ever writes to a T21 that isn't in a stream, and
+				// there is no node outside the grid, but a T30 could have
+				// values to read
+				constexpr std::array<std::pair<std::string_view, std::array<int, 2>>,
+				                     4>
+				    dirs{{{"UP", {0, -1}},
+				          {"LEFT", {-1, 0}},
+				          {"RIGHT", {1, 0}},
+				          {"DOWN", {0, 1}}}};
+				for (auto [dir, d] : dirs) {
+					if (not is_t30(sx + d[0], sy + d[1])) {
+						append(code, "MOV ", dir, ", ACC\n");
+						break;
+					}
+				}
+				if (code.empty()) {
+					// surrounded by T30s
+					code = "JRO 0\n";
+				}
+			} else {
+				code = "ADD 1\nSUB 1\n";
+			}
+			append(ret.solution, code, '\n');
+		}
+	}
+
+	// the spec, in the format of the game with get_layout_ext for any size
+	ret.spec = concat("-- generated by TIS-100-CXX generate --seed ",
+	                  params.seed, "\nfunction get_name()\n\treturn \"SYNTHETIC ",
+	                  width, 'X', height, "\"\nend\n\n",
+	                  "function get_description()\n\treturn { \"Copy each input to "
+	                  "the output below it.\" }\nend\n\n",
+	                  "function get_streams()\n\tlocal streams = {}\n\tfor _, x in "
+	                  "ipairs({");
+	for (auto [x, i] : kblib::enumerate(ret.streams)) {
+		append(ret.spec, i ? ", " : "", x);
+	}
+	append(ret.spec, "}) do\n\t\tlocal values = {}\n\t\tfor i = 1, ",
+	       params.length,
+	       " do\n\t\t\tvalues[i] = math.random(-999, 999)\n\t\tend\n"
+	       "\t\ttable.insert(streams, {STREAM_INPUT, \"IN.\" .. x, x, values})\n"
+	       "\t\ttable.insert(streams, {STREAM_OUTPUT, \"OUT.\" .. x, x, "
+	       "values})\n\tend\n\treturn streams\nend\n\n"
+	       "function get_layout_ext()\n\treturn {\n");
+	for (const auto& row : layout.nodes) {
+		ret.spec += "\t\t{ ";
+		for (auto t : row) {
+			ret.spec += t == node::T30 ? "TILE_MEMORY, " : "TILE_COMPUTE, ";
+		}
+		ret.spec += "},\n";
+	}
+	ret.spec += "\t}\nend\n";
+	return ret;
+}
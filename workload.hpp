@@ -0,0 +1,61 @@
+/* *****************************************************************************
+ * TIS-100-CXX
+ * Copyright (c) 2024 killerbee, Andrea Stacchiotti
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ****************************************************************************/
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include "builtin_specs.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct workload_params {
+	std::size_t width = 8;
+	std::size_t height = 8;
+	/// fraction of the columns that carry a stream from an input to an output
+	double traffic = .5;
+	/// fraction of the other nodes that are T30
+	double t30 = .1;
+	/// fraction of the other T21 that block forever, the rest loop on ALU
+	/// instructions
+	double stalled = .2;
+	/// fraction of the stream nodes that do arithmetic on each value, instead
+	/// of a plain MOV UP, DOWN
+	double alu = .5;
+	/// values in each stream
+	std::size_t length = 39;
+	std::uint64_t seed{};
+};
+
+/// A custom level with a solution that validates
+struct workload {
+	dynamic_layout_spec layout;
+	/// columns with an input above and an output below
+	std::vector<std::size_t> streams;
+	/// source of the custom spec, for -L
+	std::string spec;
+	std::string solution;
+};
+
+/// Generate a level and its solution, where each stream column passes its
+/// input unchanged to its output, through a T30 on the right of a node when
+/// no other node can reach it, and the other nodes are stalled or busy
+/// @throws std::invalid_argument if the parameters are out of range
+workload make_workload(const workload_params& params);
+
+#endif // WORKLOAD_HPP